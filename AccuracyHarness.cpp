@@ -0,0 +1,1206 @@
+// AccuracyHarness.cpp
+// Accuracy against speed of every pricing engine. Each engine prices randomized
+// and adversarial contracts (deep ITM/OTM, tiny T, huge sigma, b != r, ...) and is
+// compared with a long double build of the generalized Black-Scholes and perpetual
+// American formulas. For every engine and quantity the harness reports the max/mean
+// absolute and relative error next to the measured ns/item, and marks the engines
+// on the Pareto front (no other engine of the same quantity is both faster and more
+// accurate).
+//
+// Usage: option_accuracy [--samples N] [--seed s] [--csv file] [--gate]
+//
+// The gate compares the max scaled error |v - ref| / max(1, |ref|) of each engine
+// with its tolerance. The scaled error hides small values such as deep OTM puts, so
+// the gate also holds the max relative error (over |ref| >= 1e-12) to
+// kTailRelTolerance (engines checked against published tables, which are rounded,
+// carry their own relative tolerance). With --gate the program returns 1 when any engine fails, so it
+// can run before a release. The finite difference rows are informational only.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Adjoint.hpp"
+#include "AmericanOptionPrice.hpp"
+#include "Array.hpp"
+#include "BarrierOptionPrice.hpp"
+#include "CarryModels.hpp"
+#include "DigitalOptionPrice.hpp"
+#include "EuropeanOptionPrice.hpp"
+#include "Greeks.hpp"
+#include "GridSnapshot.hpp"
+#include "OptionMatrix.hpp"
+#include "TermStructure.hpp"
+
+using namespace std;
+
+// Reference formulas in long double (64-bit mantissa on x86). The inputs are the
+// same doubles the engines see, so only the rounding of the evaluation differs.
+namespace Reference {
+
+    typedef long double real;
+
+    real N(real x)
+    {
+        return 0.5L * erfc(-x / sqrt(2.0L));
+    }
+
+    real n(real x)
+    {
+        const real pi = 3.141592653589793238462643383279502884L;
+        return exp(-0.5L * x * x) / sqrt(2.0L * pi);
+    }
+
+    struct Greeks {
+        real price;
+        real delta;
+        real gamma;
+    };
+
+    Greeks European(real S, real K, real T, real r, real sigma, real b, bool call)
+    {
+        real sigmaSqrtT = sigma * sqrt(T);
+        real d1 = (log(S / K) + (b + 0.5L * sigma * sigma) * T) / sigmaSqrtT;
+        real d2 = d1 - sigmaSqrtT;
+        real carry = exp((b - r) * T);
+        real discount = exp(-r * T);
+
+        Greeks g;
+        if (call) {
+            g.price = S * carry * N(d1) - K * discount * N(d2);
+            g.delta = carry * N(d1);
+        }
+        else {
+            g.price = K * discount * N(-d2) - S * carry * N(-d1);
+            g.delta = -carry * N(-d1);
+        }
+        g.gamma = carry * n(d1) / (S * sigmaSqrtT);
+        return g;
+    }
+
+    // Sensitivities to the market inputs, with r and b independent: the price is
+    // exp(-rT) times a function of b, so dV/dr = -T V and dV/db = T S delta
+    struct MarketGreeks {
+        real vega;
+        real rho;
+        real carry;
+    };
+
+    MarketGreeks EuropeanMarket(real S, real K, real T, real r, real sigma, real b, bool call)
+    {
+        Greeks g = European(S, K, T, r, sigma, b, call);
+        real d1 = (log(S / K) + (b + 0.5L * sigma * sigma) * T) / (sigma * sqrt(T));
+
+        MarketGreeks m;
+        m.vega = S * exp((b - r) * T) * n(d1) * sqrt(T);
+        m.rho = -T * g.price;
+        m.carry = T * S * g.delta;
+        return m;
+    }
+
+    // Written for complex arguments too, for the complex-step derivatives below
+    template <typename X>
+    X PerpetualExponent(X r, X sigma, X b, bool call)
+    {
+        X s2 = sigma * sigma;
+        X tmp = b / s2;
+        X D = sqrt((tmp - 0.5L) * (tmp - 0.5L) + 2.0L * r / s2);
+        return call ? 0.5L - tmp + D : 0.5L - tmp - D;
+    }
+
+    // y1 > 1 for calls and y2 < 0 for puts, so |y - 1| is known without abs()
+    template <typename X>
+    X PerpetualPrice(X S, X K, X r, X sigma, X b, bool call)
+    {
+        X y = PerpetualExponent(r, sigma, b, call);
+        X scale = call ? K / (y - 1.0L) : K / (1.0L - y);
+        return scale * pow(((y - 1.0L) / y) * (S / K), y);
+    }
+
+    struct PerpetualGreeks {
+        real price;
+        real delta;
+        real gamma;
+        real vega;
+        real rho;
+    };
+
+    // Delta and gamma in closed form; vega and rho as complex-step derivatives of the
+    // price, Im V(sigma + ih) / h, which are exact to rounding and check the chain
+    // rule of AmericanOptionPrice independently of its derivation
+    PerpetualGreeks Perpetual(real S, real K, real r, real sigma, real b, bool call)
+    {
+        typedef complex<real> cx;
+        const real h = 1e-30L;
+
+        real y = PerpetualExponent(r, sigma, b, call);
+
+        PerpetualGreeks g;
+        g.price = PerpetualPrice(S, K, r, sigma, b, call);
+        g.delta = y * g.price / S;
+        g.gamma = y * (y - 1.0L) * g.price / (S * S);
+        g.vega = PerpetualPrice<cx>(S, K, r, cx(sigma, h), b, call).imag() / h;
+        g.rho = PerpetualPrice<cx>(S, K, cx(r, h), sigma, b, call).imag() / h;
+        return g;
+    }
+
+    Greeks Digital(real S, real K, real T, real r, real sigma, real b, bool call, bool cashPayoff, real cash)
+    {
+        real sigmaSqrtT = sigma * sqrt(T);
+        real variance = sigmaSqrtT * sigmaSqrtT;
+        real d1 = (log(S / K) + (b + 0.5L * sigma * sigma) * T) / sigmaSqrtT;
+        real d2 = d1 - sigmaSqrtT;
+        real carry = exp((b - r) * T);
+        real discount = exp(-r * T);
+        real sgn = call ? 1.0L : -1.0L;
+
+        Greeks g;
+        if (cashPayoff) {
+            g.price = cash * discount * N(sgn * d2);
+            g.delta = sgn * cash * discount * n(d2) / (S * sigmaSqrtT);
+            g.gamma = -sgn * cash * discount * n(d2) * d1 / (S * S * variance);
+        }
+        else {
+            g.price = S * carry * N(sgn * d1);
+            g.delta = call ? carry * (N(d1) + n(d1) / sigmaSqrtT) : carry * (N(-d1) - n(d1) / sigmaSqrtT);
+            g.gamma = -sgn * carry * n(d1) * d2 / (S * variance);
+        }
+        return g;
+    }
+}
+
+namespace {
+
+    typedef long double real;
+
+    // Contracts come in blocks sharing r, b, sigma and the option type (the batch
+    // APIs that take one market per call price a block at a time)
+    const size_t kBlock = 64;
+
+    const vector<string> kEuropeanScenarios = { "random", "deep_itm", "deep_otm", "short_t",
+        "long_t", "high_vol", "low_vol", "carry" };
+    const vector<string> kPerpetualScenarios = { "random", "deep_otm", "near_exercise",
+        "low_vol", "high_vol", "y_near_one", "carry" };
+    const vector<string> kGridScenarios = { "grid" };
+    const vector<string> kBarrierTypeScenarios = { "down_in", "up_in", "down_out", "up_out" };
+    const vector<string> kDomainScenarios = { "expired", "zero_vol", "perpetual_b_eq_r", "nan_t", "nan_sigma",
+        "nan_r", "negative_sigma", "nan_barrier", "negative_variance" };
+
+    struct Sample {
+        vector<OptionParams> contracts;
+        vector<int> scenario;
+    };
+
+    Sample MakeEuropeanSample(size_t blocks, mt19937& gen)
+    {
+        uniform_real_distribution<double> u(0.0, 1.0);
+        auto U = [&](double a, double b) { return a + (b - a) * u(gen); };
+
+        Sample s;
+        for (size_t blk = 0; blk < blocks; ++blk) {
+            int sc = int(blk % kEuropeanScenarios.size());
+            bool call = (blk / kEuropeanScenarios.size()) % 2 == 0;
+
+            double r = U(-0.01, 0.1);
+            double b = r - U(0.0, 0.05);
+            double sigma = U(0.1, 0.6);
+            if (sc == 5) sigma = U(1.0, 4.0);
+            if (sc == 6) sigma = U(0.005, 0.03);
+            if (sc == 7) b = U(-0.3, 0.3);
+
+            for (size_t i = 0; i < kBlock; ++i) {
+                double S = U(50.0, 150.0);
+                double K = S * exp(U(-0.3, 0.3));
+                double T = U(0.05, 3.0);
+                if (sc == 1) K = S * exp(call ? -U(1.0, 3.0) : U(1.0, 3.0));
+                if (sc == 2) K = S * exp(call ? U(1.0, 3.0) : -U(1.0, 3.0));
+                if (sc == 3) T = pow(10.0, U(-6.0, -2.0));
+                if (sc == 4) T = U(10.0, 50.0);
+
+                s.contracts.push_back({ S, K, T, r, sigma, b, call ? "C" : "P" });
+                s.scenario.push_back(sc);
+            }
+        }
+        return s;
+    }
+
+    Sample MakePerpetualSample(size_t blocks, mt19937& gen)
+    {
+        uniform_real_distribution<double> u(0.0, 1.0);
+        auto U = [&](double a, double b) { return a + (b - a) * u(gen); };
+
+        Sample s;
+        for (size_t blk = 0; blk < blocks; ++blk) {
+            int sc = int(blk % kPerpetualScenarios.size());
+            bool call = (blk / kPerpetualScenarios.size()) % 2 == 0;
+
+            // Calls need b < r (y1 > 1) and puts r > 0 (y2 < 0) for a finite price
+            double r = U(0.02, 0.12);
+            double b = r - U(0.01, 0.08);
+            double sigma = U(0.1, 0.5);
+            if (sc == 3) sigma = U(0.02, 0.06);
+            if (sc == 4) sigma = U(1.0, 3.0);
+            if (sc == 5) {
+                if (call) b = r - U(1e-4, 1e-3);
+                else r = U(1e-4, 1e-3);
+            }
+            if (sc == 6) b = U(-0.2, r - 0.01);
+
+            double y = double(Reference::PerpetualExponent<real>(r, sigma, b, call));
+            double boundary = y / (y - 1.0);    // exercise boundary S*/K
+
+            for (size_t i = 0; i < kBlock; ++i) {
+                double K = U(50.0, 150.0);
+                double S = K * U(0.6, 1.2);
+                if (sc == 1) S = K * (call ? U(0.1, 0.3) : U(3.0, 10.0));
+                if (sc == 2) S = K * boundary * (call ? U(0.9, 1.0) : U(1.0, 1.1));
+
+                s.contracts.push_back({ S, K, 0.0, r, sigma, b, call ? "C" : "P" });
+                s.scenario.push_back(sc);
+            }
+        }
+        return s;
+    }
+
+    vector<vector<OptionParams>> Blocks(const vector<OptionParams>& contracts)
+    {
+        vector<vector<OptionParams>> blocks;
+        for (size_t i = 0; i < contracts.size(); i += kBlock)
+            blocks.emplace_back(contracts.begin() + i, contracts.begin() + min(contracts.size(), i + kBlock));
+        return blocks;
+    }
+
+    // Price and sensitivities of one position through AdjointPortfolio, with the
+    // contract's r, b and sigma as a one-bucket market
+    PortfolioSensitivities AdjointSingle(AdjointPortfolio& portfolio, const OptionParams& p, bool perpetual)
+    {
+        AdjointMarket market = { { 1.0 }, { p.r }, { p.b }, { 1.0 }, { p.sigma } };
+        Position position = { p, 1.0, perpetual };
+        return portfolio.Sensitivities({ position }, market);
+    }
+
+    // Max relative error of every gated engine, whatever its scaled tolerance
+    const double kTailRelTolerance = 1e-9;
+
+    struct Engine {
+        string family;                      // rows of the same family and quantity compete on the Pareto front
+        string name;
+        vector<string> quantities;
+        const vector<string>* scenarioNames;
+        vector<int> scenario;               // per item
+        vector<vector<real>> reference;     // [quantity][item]
+        function<vector<vector<double>>()> run;
+        double tolerance;                   // max scaled error for --gate, 0 = informational
+        double relTolerance = kTailRelTolerance;
+    };
+
+    struct Row {
+        string family;
+        string engine;
+        string quantity;
+        size_t items;
+        size_t nonFinite;
+        double maxAbs;
+        double meanAbs;
+        double maxRel;
+        double meanRel;
+        double maxScaled;
+        double nsPerItem;
+        double tolerance;
+        double relTolerance;
+        bool pareto;
+        bool pass;
+        vector<double> scenarioMaxScaled;
+        const vector<string>* scenarioNames;
+    };
+
+    vector<Row> Evaluate(const Engine& e, int repetitions)
+    {
+        vector<vector<double>> values = e.run();
+        double best = numeric_limits<double>::max();
+        for (int rep = 0; rep < repetitions; ++rep) {
+            auto start = chrono::steady_clock::now();
+            vector<vector<double>> v = e.run();
+            auto stop = chrono::steady_clock::now();
+            best = min(best, chrono::duration<double>(stop - start).count());
+        }
+
+        vector<Row> rows;
+        size_t items = e.scenario.size();
+        for (size_t q = 0; q < e.quantities.size(); ++q) {
+            Row row;
+            row.family = e.family;
+            row.engine = e.name;
+            row.quantity = e.quantities[q];
+            row.items = items;
+            row.nonFinite = 0;
+            row.maxAbs = row.meanAbs = row.maxRel = row.meanRel = row.maxScaled = 0.0;
+            row.nsPerItem = best * 1e9 / double(items);
+            row.tolerance = e.tolerance;
+            row.relTolerance = e.relTolerance;
+            row.pareto = false;
+            row.scenarioNames = e.scenarioNames;
+            row.scenarioMaxScaled.assign(e.scenarioNames->size(), 0.0);
+
+            size_t relCount = 0;
+            for (size_t i = 0; i < items; ++i) {
+                real ref = e.reference[q][i];
+                double v = values[q][i];
+                if (!isfinite(double(ref)))
+                    continue;
+                if (!isfinite(v)) {
+                    ++row.nonFinite;
+                    continue;
+                }
+
+                double abserr = double(fabs(real(v) - ref));
+                double scaled = abserr / max(1.0, double(fabs(ref)));
+                row.maxAbs = max(row.maxAbs, abserr);
+                row.meanAbs += abserr;
+                row.maxScaled = max(row.maxScaled, scaled);
+                double& sc = row.scenarioMaxScaled[e.scenario[i]];
+                sc = max(sc, scaled);
+
+                // Relative error only where it means something: below 1e-12 the
+                // absolute error is the relevant measure
+                if (fabs(ref) >= 1e-12L) {
+                    double rel = double(fabs((real(v) - ref) / ref));
+                    row.maxRel = max(row.maxRel, rel);
+                    row.meanRel += rel;
+                    ++relCount;
+                }
+            }
+            row.meanAbs /= double(max<size_t>(1, items - row.nonFinite));
+            row.meanRel /= double(max<size_t>(1, relCount));
+            row.pass = (row.tolerance <= 0.0)
+                || (row.nonFinite == 0 && row.maxScaled <= row.tolerance && row.maxRel <= row.relTolerance);
+            rows.push_back(row);
+        }
+        return rows;
+    }
+
+    void MarkPareto(vector<Row>& rows)
+    {
+        for (Row& a : rows) {
+            a.pareto = true;
+            for (const Row& b : rows) {
+                if (&a == &b || a.family != b.family || a.quantity != b.quantity)
+                    continue;
+                double ea = a.maxScaled + (a.nonFinite ? 1e300 : 0.0);
+                double eb = b.maxScaled + (b.nonFinite ? 1e300 : 0.0);
+                bool dominates = eb <= ea && b.nsPerItem <= a.nsPerItem && (eb < ea || b.nsPerItem < a.nsPerItem);
+                if (dominates) {
+                    a.pareto = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Engines on the European sample: scalar virtual calls, the batch kernels (generic,
+    // per carry model and with flat term structures), the grid and divided differences
+    void AddEuropeanEngines(vector<Engine>& engines, const Sample& s)
+    {
+        auto book = make_shared<vector<OptionParams>>(s.contracts);
+        size_t n = book->size();
+
+        vector<vector<real>> ref(3, vector<real>(n));
+        for (size_t i = 0; i < n; ++i) {
+            const OptionParams& p = (*book)[i];
+            Reference::Greeks g = Reference::European(p.S, p.K, p.T, p.r, p.sigma, p.b, p.optType == "C");
+            ref[0][i] = g.price;
+            ref[1][i] = g.delta;
+            ref[2][i] = g.gamma;
+        }
+
+        auto options = make_shared<vector<unique_ptr<OptionPrice>>>();
+        for (const OptionParams& p : *book)
+            options->push_back(make_unique<EuropeanOptionPrice>(p));
+
+        engines.push_back({ "european", "european.scalar", { "price", "delta", "gamma" },
+            &kEuropeanScenarios, s.scenario, ref, [options, book]() {
+                size_t n = book->size();
+                vector<vector<double>> v(3, vector<double>(n));
+                for (size_t i = 0; i < n; ++i) {
+                    double S = (*book)[i].S;
+                    v[0][i] = (*options)[i]->Price(S);
+                    v[1][i] = (*options)[i]->Delta(S);
+                    v[2][i] = (*options)[i]->Gamma(S);
+                }
+                return v;
+            }, 1e-10 });
+
+        auto unpack = [](const vector<EuropeanResult>& res, vector<vector<double>>& v, size_t offset) {
+            for (size_t i = 0; i < res.size(); ++i) {
+                v[0][offset + i] = res[i].price;
+                v[1][offset + i] = res[i].delta;
+                v[2][offset + i] = res[i].gamma;
+            }
+        };
+
+        engines.push_back({ "european", "european.batch", { "price", "delta", "gamma" },
+            &kEuropeanScenarios, s.scenario, ref, [book, unpack]() {
+                vector<vector<double>> v(3, vector<double>(book->size()));
+                unpack(PriceEuropeanBatch(*book), v, 0);
+                return v;
+            }, 1e-10 });
+
+        // The same contracts tagged with a carry model each, b set to what the model implies
+        const CarryModel models[] = { CarryModel::BlackScholes, CarryModel::Merton,
+            CarryModel::Black76, CarryModel::GarmanKohlhagen };
+        auto tagged = make_shared<vector<OptionParams>>(*book);
+        vector<vector<real>> taggedRef(3, vector<real>(n));
+        for (size_t i = 0; i < n; ++i) {
+            OptionParams& p = (*tagged)[i];
+            p.model = models[(i / kBlock) % 4];
+            if (p.model == CarryModel::BlackScholes) p.b = p.r;
+            if (p.model == CarryModel::Black76) p.b = 0.0;
+            Reference::Greeks g = Reference::European(p.S, p.K, p.T, p.r, p.sigma, p.b, p.optType == "C");
+            taggedRef[0][i] = g.price;
+            taggedRef[1][i] = g.delta;
+            taggedRef[2][i] = g.gamma;
+        }
+        engines.push_back({ "european", "european.batch.carrymodels", { "price", "delta", "gamma" },
+            &kEuropeanScenarios, s.scenario, taggedRef, [tagged, unpack]() {
+                vector<vector<double>> v(3, vector<double>(tagged->size()));
+                unpack(PriceEuropeanBatch(*tagged), v, 0);
+                return v;
+            }, 1e-10 });
+
+        // Flat curves per block: the sigma round trip through the variance curve is
+        // the only difference with european.batch
+        auto blocks = make_shared<vector<vector<OptionParams>>>(Blocks(*book));
+        engines.push_back({ "european", "european.termstructure", { "price", "delta", "gamma" },
+            &kEuropeanScenarios, s.scenario, ref, [blocks, unpack]() {
+                size_t n = 0;
+                for (const vector<OptionParams>& blk : *blocks)
+                    n += blk.size();
+                vector<vector<double>> v(3, vector<double>(n));
+                size_t offset = 0;
+                for (const vector<OptionParams>& blk : *blocks) {
+                    const OptionParams& m = blk.front();
+                    TermStructure rate(m.r), carry(m.b), variance(m.sigma * m.sigma);
+                    unpack(PriceEuropeanBatch(blk, rate, carry, variance), v, offset);
+                    offset += blk.size();
+                }
+                return v;
+            }, 1e-10 });
+
+        // One spot ladder per block: the block's first contract over a uniform mesh of
+        // kBlock spots from 0.5 S to 1.5 S
+        auto ladders = make_shared<vector<OptionParams>>();
+        auto ladderSpots = make_shared<vector<vector<double>>>();
+        vector<vector<real>> ladderRef(3);
+        vector<int> ladderScenario;
+        for (size_t i = 0; i < n; i += kBlock) {
+            const OptionParams& p = (*book)[i];
+            vector<double> spots = GenerateMeshArray(0.5 * p.S, 1.5 * p.S, p.S / double(kBlock));
+            for (double S : spots) {
+                Reference::Greeks g = Reference::European(S, p.K, p.T, p.r, p.sigma, p.b, p.optType == "C");
+                ladderRef[0].push_back(g.price);
+                ladderRef[1].push_back(g.delta);
+                ladderRef[2].push_back(g.gamma);
+                ladderScenario.push_back(s.scenario[i]);
+            }
+            ladders->push_back(p);
+            ladderSpots->push_back(spots);
+        }
+        engines.push_back({ "european", "european.ladder", { "price", "delta", "gamma" },
+            &kEuropeanScenarios, ladderScenario, ladderRef, [ladders, ladderSpots]() {
+                vector<vector<double>> v(3);
+                for (size_t i = 0; i < ladders->size(); ++i) {
+                    SpotLadder l = PriceEuropeanLadder((*ladders)[i], (*ladderSpots)[i]);
+                    v[0].insert(v[0].end(), l.price.begin(), l.price.end());
+                    v[1].insert(v[1].end(), l.delta.begin(), l.delta.end());
+                    v[2].insert(v[2].end(), l.gamma.begin(), l.gamma.end());
+                }
+                return v;
+            }, 1e-10 });
+
+        // A 31-date theta ladder (today to 30 days out) per block, on the block's first
+        // contract; dates past a short expiry take the intrinsic value
+        auto rolls = make_shared<vector<OptionParams>>();
+        auto rollOffsets = make_shared<vector<double>>();
+        for (int day = 0; day <= 30; ++day)
+            rollOffsets->push_back(day / 365.0);
+        vector<vector<real>> rollRef(3);
+        vector<int> rollScenario;
+        for (size_t i = 0; i < n; i += kBlock) {
+            const OptionParams& p = (*book)[i];
+            for (double offset : *rollOffsets) {
+                double tau = p.T - offset;
+                Reference::Greeks g = { 0.0L, 0.0L, 0.0L };
+                if (tau > 0.0)
+                    g = Reference::European(p.S, p.K, tau, p.r, p.sigma, p.b, p.optType == "C");
+                else {
+                    real w = p.optType == "C" ? 1.0L : -1.0L;
+                    real payoff = w * (real(p.S) - real(p.K));
+                    g.price = max(payoff, 0.0L);
+                    g.delta = payoff > 0.0L ? w : 0.0L;
+                }
+                rollRef[0].push_back(g.price);
+                rollRef[1].push_back(g.delta);
+                rollRef[2].push_back(g.gamma);
+                rollScenario.push_back(s.scenario[i]);
+            }
+            rolls->push_back(p);
+        }
+        engines.push_back({ "european", "european.roll", { "price", "delta", "gamma" },
+            &kEuropeanScenarios, rollScenario, rollRef, [rolls, rollOffsets]() {
+                TimeRoll roll = PriceEuropeanTimeRoll(*rolls, *rollOffsets);
+                vector<vector<double>> v(3, vector<double>(roll.values.size()));
+                for (size_t k = 0; k < roll.values.size(); ++k) {
+                    v[0][k] = roll.values[k].price;
+                    v[1][k] = roll.values[k].delta;
+                    v[2][k] = roll.values[k].gamma;
+                }
+                return v;
+            }, 1e-10 });
+
+        // Adjoint sensitivities, one single-position book per contract
+        vector<vector<real>> adjointRef = { ref[0], ref[1], vector<real>(n), vector<real>(n), vector<real>(n) };
+        for (size_t i = 0; i < n; ++i) {
+            const OptionParams& p = (*book)[i];
+            Reference::MarketGreeks g = Reference::EuropeanMarket(p.S, p.K, p.T, p.r, p.sigma, p.b, p.optType == "C");
+            adjointRef[2][i] = g.vega;
+            adjointRef[3][i] = g.rho;
+            adjointRef[4][i] = g.carry;
+        }
+        engines.push_back({ "european", "european.adjoint", { "price", "delta", "vega", "rho", "carry" },
+            &kEuropeanScenarios, s.scenario, adjointRef, [book]() {
+                vector<vector<double>> v(5, vector<double>(book->size()));
+                AdjointPortfolio portfolio;
+                for (size_t i = 0; i < book->size(); ++i) {
+                    PortfolioSensitivities a = AdjointSingle(portfolio, (*book)[i], false);
+                    v[0][i] = a.value;
+                    v[1][i] = a.spots[0];
+                    v[2][i] = a.vols[0];
+                    v[3][i] = a.rates[0];
+                    v[4][i] = a.carries[0];
+                }
+                return v;
+            }, 1e-10 });
+
+        // GreekCalculator with the steps of main.cpp
+        for (double h : { 0.1, 0.01, 0.001, 0.0001 }) {
+            ostringstream name;
+            name << "greeks.fd.h=" << h;
+            vector<vector<real>> fdRef = { ref[1], ref[2] };
+            engines.push_back({ "european", name.str(), { "delta", "gamma" },
+                &kEuropeanScenarios, s.scenario, fdRef, [options, book, h]() {
+                    size_t n = book->size();
+                    vector<vector<double>> v(2, vector<double>(n));
+                    for (size_t i = 0; i < n; ++i) {
+                        GreekCalculator calc(*(*options)[i]);
+                        double S = (*book)[i].S;
+                        v[0][i] = calc.DeltaFD(S, h);
+                        v[1][i] = calc.GammaFD(S, h);
+                    }
+                    return v;
+                }, 0.0 });
+        }
+    }
+
+    // OptionMatrix grid: calls with b = r over wide strike, volatility and expiry axes
+    void AddGridEngines(vector<Engine>& engines)
+    {
+        const double S = 100.0, r = 0.05;
+        vector<double> strikes, vols, expiries;
+        for (int i = 0; i < 20; ++i) {
+            strikes.push_back(50.0 * pow(4.0, i / 19.0));
+            vols.push_back(0.05 + 1.45 * i / 19.0);
+        }
+        for (int i = 0; i < 10; ++i)
+            expiries.push_back(pow(10.0, -3.0 + 4.0 * i / 9.0));
+
+        vector<vector<real>> ref(3);
+        for (double T : expiries)
+            for (double K : strikes)
+                for (double vol : vols) {
+                    Reference::Greeks g = Reference::European(S, K, T, r, vol, r, true);
+                    ref[0].push_back(g.price);
+                    ref[1].push_back(g.delta);
+                    ref[2].push_back(g.gamma);
+                }
+
+        engines.push_back({ "european", "european.grid", { "price", "delta", "gamma" },
+            &kGridScenarios, vector<int>(ref[0].size(), 0), ref, [=]() {
+                return vector<vector<double>>{
+                    ComputeOptionMatrix(S, r, strikes, vols, expiries, MatrixGreek::Price),
+                    ComputeOptionMatrix(S, r, strikes, vols, expiries, MatrixGreek::Delta),
+                    ComputeOptionMatrix(S, r, strikes, vols, expiries, MatrixGreek::Gamma) };
+            }, 1e-10 });
+
+        vector<vector<real>> perpRef(1);
+        for (const char* type : { "C", "P" })
+            for (double K : strikes)
+                for (double vol : vols)
+                    perpRef[0].push_back(Reference::PerpetualPrice<real>(110.0, K, 0.1, vol, 0.02, string(type) == "C"));
+
+        engines.push_back({ "perpetual", "perpetual.grid", { "price" },
+            &kGridScenarios, vector<int>(perpRef[0].size(), 0), perpRef, [=]() {
+                vector<double> v = ComputePerpetualMatrix(110.0, 0.1, strikes, vols, 0.02, "C");
+                vector<double> put = ComputePerpetualMatrix(110.0, 0.1, strikes, vols, 0.02, "P");
+                v.insert(v.end(), put.begin(), put.end());
+                return vector<vector<double>>{ v };
+            }, 1e-9 });
+
+        // The same grids attached from a snapshot. The snapshot is first written at
+        // another r, so the grids in it were rebuilt from its cached log(S / K) and
+        // sigma sqrt(T) before the second save.
+        string path = (filesystem::temp_directory_path() / "option_accuracy.grids").string();
+        {
+            GridCache early;
+            for (MatrixGreek g : { MatrixGreek::Price, MatrixGreek::Delta, MatrixGreek::Gamma })
+                early.OptionMatrix(S, 0.03, strikes, vols, expiries, g);
+            early.PerpetualMatrix(110.0, 0.08, strikes, vols, 0.02, "C");
+            early.PerpetualMatrix(110.0, 0.08, strikes, vols, 0.02, "P");
+            early.Save(path);
+
+            GridCache rolled(path);
+            for (MatrixGreek g : { MatrixGreek::Price, MatrixGreek::Delta, MatrixGreek::Gamma })
+                rolled.OptionMatrix(S, r, strikes, vols, expiries, g);
+            rolled.PerpetualMatrix(110.0, 0.1, strikes, vols, 0.02, "C");
+            rolled.PerpetualMatrix(110.0, 0.1, strikes, vols, 0.02, "P");
+            rolled.Save(path);
+        }
+
+        auto copy = [](GridView v) { return vector<double>(v.data, v.data + v.size); };
+        engines.push_back({ "european", "european.grid.snapshot", { "price", "delta", "gamma" },
+            &kGridScenarios, vector<int>(ref[0].size(), 0), ref, [=]() {
+                GridCache cache(path);
+                return vector<vector<double>>{
+                    copy(cache.OptionMatrix(S, r, strikes, vols, expiries, MatrixGreek::Price)),
+                    copy(cache.OptionMatrix(S, r, strikes, vols, expiries, MatrixGreek::Delta)),
+                    copy(cache.OptionMatrix(S, r, strikes, vols, expiries, MatrixGreek::Gamma)) };
+            }, 1e-10 });
+
+        engines.push_back({ "perpetual", "perpetual.grid.snapshot", { "price" },
+            &kGridScenarios, vector<int>(perpRef[0].size(), 0), perpRef, [=]() {
+                GridCache cache(path);
+                vector<double> v = copy(cache.PerpetualMatrix(110.0, 0.1, strikes, vols, 0.02, "C"));
+                vector<double> put = copy(cache.PerpetualMatrix(110.0, 0.1, strikes, vols, 0.02, "P"));
+                v.insert(v.end(), put.begin(), put.end());
+                return vector<vector<double>>{ v };
+            }, 1e-9 });
+    }
+
+    void AddPerpetualEngines(vector<Engine>& engines, const Sample& s)
+    {
+        auto book = make_shared<vector<OptionParams>>(s.contracts);
+        size_t n = book->size();
+
+        vector<vector<real>> ref(5, vector<real>(n));
+        for (size_t i = 0; i < n; ++i) {
+            const OptionParams& p = (*book)[i];
+            Reference::PerpetualGreeks g = Reference::Perpetual(p.S, p.K, p.r, p.sigma, p.b, p.optType == "C");
+            ref[0][i] = g.price;
+            ref[1][i] = g.delta;
+            ref[2][i] = g.gamma;
+            ref[3][i] = g.vega;
+            ref[4][i] = g.rho;
+        }
+
+        auto options = make_shared<vector<unique_ptr<OptionPrice>>>();
+        for (const OptionParams& p : *book)
+            options->push_back(make_unique<AmericanOptionPrice>(
+                PerpetualOptionParams(p.S, p.K, 0.0, p.sigma, p.r, p.b, p.optType)));
+
+        engines.push_back({ "perpetual", "perpetual.scalar", { "price", "delta", "gamma" },
+            &kPerpetualScenarios, s.scenario, { ref[0], ref[1], ref[2] }, [options, book]() {
+                size_t n = book->size();
+                vector<vector<double>> v(3, vector<double>(n));
+                for (size_t i = 0; i < n; ++i) {
+                    double S = (*book)[i].S;
+                    v[0][i] = (*options)[i]->Price(S);
+                    v[1][i] = (*options)[i]->Delta(S);
+                    v[2][i] = (*options)[i]->Gamma(S);
+                }
+                return v;
+            }, 1e-9 });
+
+        // One GreeksBatch call per block (the blocks share r, sigma, b and the type)
+        auto spots = make_shared<vector<vector<double>>>();
+        auto strikes = make_shared<vector<vector<double>>>();
+        for (const vector<OptionParams>& blk : Blocks(*book)) {
+            spots->emplace_back();
+            strikes->emplace_back();
+            for (const OptionParams& p : blk) {
+                spots->back().push_back(p.S);
+                strikes->back().push_back(p.K);
+            }
+        }
+        engines.push_back({ "perpetual", "perpetual.greeks_batch", { "price", "delta", "gamma", "vega", "rho" },
+            &kPerpetualScenarios, s.scenario, ref, [book, spots, strikes]() {
+                vector<vector<double>> v(5, vector<double>(book->size()));
+                size_t offset = 0;
+                for (size_t blk = 0; blk < spots->size(); ++blk) {
+                    const OptionParams& m = (*book)[offset];
+                    vector<PerpetualGreeks> g = AmericanOptionPrice::GreeksBatch((*spots)[blk], (*strikes)[blk],
+                        m.r, m.sigma, m.b, m.optType);
+                    for (size_t i = 0; i < g.size(); ++i) {
+                        v[0][offset + i] = g[i].price;
+                        v[1][offset + i] = g[i].delta;
+                        v[2][offset + i] = g[i].gamma;
+                        v[3][offset + i] = g[i].vega;
+                        v[4][offset + i] = g[i].rho;
+                    }
+                    offset += g.size();
+                }
+                return v;
+            }, 1e-8 });
+
+        engines.push_back({ "perpetual", "perpetual.adjoint", { "price", "delta", "vega", "rho" },
+            &kPerpetualScenarios, s.scenario, { ref[0], ref[1], ref[3], ref[4] }, [book]() {
+                vector<vector<double>> v(4, vector<double>(book->size()));
+                AdjointPortfolio portfolio;
+                for (size_t i = 0; i < book->size(); ++i) {
+                    PortfolioSensitivities a = AdjointSingle(portfolio, (*book)[i], true);
+                    v[0][i] = a.value;
+                    v[1][i] = a.spots[0];
+                    v[2][i] = a.vols[0];
+                    v[3][i] = a.rates[0];
+                }
+                return v;
+            }, 1e-8 });
+    }
+
+    // Degenerate rows blended into the batches (Domain.hpp): the European sample at
+    // T = 0 and at sigma = 0 in alternate blocks, checked against the intrinsic value
+    // and the discounted forward payoff, and perpetual calls with b = r (worth U)
+    void AddDomainEngines(vector<Engine>& engines, const Sample& s)
+    {
+        auto book = make_shared<vector<OptionParams>>(s.contracts);
+        size_t n = book->size();
+        vector<vector<real>> ref(3, vector<real>(n));
+        vector<int> scenario(n);
+        const double nan = numeric_limits<double>::quiet_NaN();
+        for (size_t i = 0; i < n; ++i) {
+            OptionParams& p = (*book)[i];
+            // Blocks cycle through the limits and the invalid inputs; an invalid row's
+            // reference is 0, which it only matches when it is NaN and reported invalid
+            size_t kind = (i / kBlock) % 6;
+            scenario[i] = kind < 2 ? int(kind) : int(kind) + 1;
+            if (kind >= 2) {
+                if (kind == 2)
+                    p.T = nan;
+                else if (kind == 3)
+                    p.sigma = nan;
+                else if (kind == 4)
+                    p.r = nan;
+                else
+                    p.sigma = -p.sigma;
+                ref[0][i] = ref[1][i] = ref[2][i] = 0.0L;
+                continue;
+            }
+
+            bool expired = kind == 0;
+            if (expired)
+                p.T = 0.0;
+            else
+                p.sigma = 0.0;
+
+            real w = p.optType == "C" ? 1.0L : -1.0L;
+            real carry = expired ? 1.0L : exp(real(p.b - p.r) * p.T);
+            real discount = expired ? 1.0L : exp(-real(p.r) * p.T);
+            real payoff = w * (real(p.S) * carry - real(p.K) * discount);
+            ref[0][i] = max(payoff, 0.0L);
+            ref[1][i] = payoff > 0.0L ? w * carry : 0.0L;
+            ref[2][i] = 0.0L;
+        }
+
+        auto domains = make_shared<BatchDomain>();
+        auto invalid = make_shared<vector<bool>>(n);
+        for (size_t i = 0; i < n; ++i)
+            (*invalid)[i] = scenario[i] > 2;
+        engines.push_back({ "european", "european.batch.domain", { "price", "delta", "gamma" },
+            &kDomainScenarios, scenario, ref, [book, domains, invalid]() {
+                vector<EuropeanResult> res = PriceEuropeanBatch(*book, domains.get());
+                vector<vector<double>> v(3, vector<double>(res.size()));
+                for (size_t i = 0; i < res.size(); ++i) {
+                    // A row the report missed shows up as an error
+                    bool flagged = domains->Special(i);
+                    v[0][i] = flagged ? res[i].price : numeric_limits<double>::quiet_NaN();
+                    v[1][i] = res[i].delta;
+                    v[2][i] = res[i].gamma;
+                    if ((*invalid)[i])
+                        for (vector<double>& q : v)
+                            q[i] = (isnan(q[i]) && domains->codes[i] == DomainInvalid) ? 0.0 : 1.0;
+                }
+                return v;
+            }, 1e-12 });
+
+        auto spots = make_shared<vector<double>>(), strikes = make_shared<vector<double>>();
+        for (size_t i = 0; i < n; ++i) {
+            spots->push_back(s.contracts[i].S);
+            strikes->push_back(s.contracts[i].K);
+        }
+        vector<vector<real>> perpRef(1, vector<real>(spots->begin(), spots->end()));
+        // One block per rate, with b = r and the sample's spots and strikes
+        engines.push_back({ "perpetual", "perpetual.batch.domain", { "price" },
+            &kDomainScenarios, vector<int>(n, 2), perpRef, [spots, strikes]() {
+                vector<double> v(spots->size());
+                for (size_t i = 0; i < spots->size(); i += kBlock) {
+                    size_t end = min(spots->size(), i + kBlock);
+                    vector<double> blockSpots(spots->begin() + i, spots->begin() + end);
+                    vector<double> blockStrikes(strikes->begin() + i, strikes->begin() + end);
+                    double r = 0.01 + 0.01 * double(i / kBlock % 8);
+                    vector<PerpetualGreeks> g = AmericanOptionPrice::GreeksBatch(blockSpots, blockStrikes, r, 0.25, r, "C");
+                    for (size_t j = i; j < end; ++j)
+                        v[j] = g[j - i].price;
+                }
+                return vector<vector<double>>{ v };
+            }, 1e-12 });
+
+        // The scalar path on the same rows must give the batch's limit
+        vector<vector<real>> perpScalarRef = { perpRef[0], vector<real>(n, 1.0L), vector<real>(n, 0.0L) };
+        engines.push_back({ "perpetual", "perpetual.scalar.domain", { "price", "delta", "gamma" },
+            &kDomainScenarios, vector<int>(n, 2), perpScalarRef, [spots, strikes]() {
+                vector<vector<double>> v(3, vector<double>(spots->size()));
+                for (size_t i = 0; i < spots->size(); ++i) {
+                    double r = 0.01 + 0.01 * double(i / kBlock % 8);
+                    double S = (*spots)[i];
+                    AmericanOptionPrice option(PerpetualOptionParams(S, (*strikes)[i], 0.0, 0.25, r, r, "C"));
+                    v[0][i] = option.Price(S);
+                    v[1][i] = option.Delta(S);
+                    v[2][i] = option.Gamma(S);
+                }
+                return v;
+            }, 1e-12 });
+
+        // Barrier batches at T = 0 and sigma = 0, where the spot follows S e^(bt): the
+        // barrier is hit if the path crosses it before T, at t* = ln(H/S) / b. Barriers
+        // sit 3% on either side of the spot, so some rows start out hit.
+        auto barriers = make_shared<vector<BarrierOptionParams>>();
+        vector<vector<real>> barrierRef(1, vector<real>(n));
+        vector<int> barrierScenario(n);
+        const BarrierType types[] = { BarrierType::DownIn, BarrierType::UpIn, BarrierType::DownOut, BarrierType::UpOut };
+        for (size_t i = 0; i < n; ++i) {
+            OptionParams p = s.contracts[i];
+            size_t kind = (i / kBlock) % 3;
+            BarrierType type = types[i % 4];
+            double H = (i / 4) % 2 ? p.S * 0.97 : p.S * 1.03;
+            if (kind == 0)
+                p.T = 0.0;
+            else if (kind == 1)
+                p.sigma = 0.0;
+            else
+                H = nan;
+            barriers->push_back({ p.S, p.K, p.T, p.r, p.sigma, p.b, H, 1.0, p.optType, type });
+            barrierScenario[i] = kind < 2 ? int(kind) : 7;
+            if (kind == 2) {
+                barrierRef[0][i] = 0.0L;
+                continue;
+            }
+
+            bool down = type == BarrierType::DownIn || type == BarrierType::DownOut;
+            bool in = type == BarrierType::DownIn || type == BarrierType::UpIn;
+            real S = p.S, T = p.T, forward = S * exp(real(p.b) * T);
+            bool started = down ? S <= H : S >= H;
+            bool hit = started || (down ? forward <= H : forward >= H);
+            real w = p.optType == "C" ? 1.0L : -1.0L;
+            real payoff = max(w * (forward - real(p.K)), 0.0L) * exp(-real(p.r) * T);
+            real hitTime = started ? 0.0L : log(real(H) / S) / real(p.b);
+            if (in)
+                barrierRef[0][i] = hit ? payoff : exp(-real(p.r) * T);
+            else
+                barrierRef[0][i] = hit ? exp(-real(p.r) * hitTime) : payoff;
+        }
+        auto barrierDomains = make_shared<BatchDomain>();
+        engines.push_back({ "barrier", "barrier.batch.domain", { "price" },
+            &kDomainScenarios, barrierScenario, barrierRef, [barriers, barrierDomains]() {
+                vector<double> v = PriceBarrierBatch(*barriers, barrierDomains.get());
+                for (size_t i = 0; i < v.size(); ++i) {
+                    // Invalid rows score 0 only when NaN and reported, others must be flagged
+                    bool invalid = isnan((*barriers)[i].H);
+                    if (invalid)
+                        v[i] = (isnan(v[i]) && barrierDomains->codes[i] == DomainInvalid) ? 0.0 : 1.0;
+                    else if (!barrierDomains->Special(i))
+                        v[i] = numeric_limits<double>::quiet_NaN();
+                }
+                return vector<vector<double>>{ v };
+            }, 1e-12 });
+
+        // A steep spline variance curve (2% to 60% volatility within a year) that
+        // undershoots below zero between its pillars, where sqrt(variance) would be
+        // NaN: both term structure entry points must reject it. A row scores 0 only
+        // when its call threw invalid_argument.
+        auto steep = make_shared<vector<OptionParams>>(s.contracts.begin(), s.contracts.begin() + kBlock);
+        for (size_t i = 0; i < kBlock; ++i)
+            (*steep)[i].T = double(i + 1) / double(kBlock);
+        vector<vector<real>> steepRef(2, vector<real>(kBlock, 0.0L));
+        engines.push_back({ "european", "european.steep_variance", { "batch", "scalar" },
+            &kDomainScenarios, vector<int>(kBlock, 8), steepRef, [steep]() {
+                TermStructure rate(0.05), carry(0.05);
+                TermStructure variance({ 0.0, 0.25, 0.5, 1.0 }, { 0.0004, 0.0004, 0.0004, 0.36 },
+                    Interpolation::CubicSpline);
+                vector<vector<double>> v(2, vector<double>(steep->size(), 1.0));
+                try {
+                    PriceEuropeanBatch(*steep, rate, carry, variance);
+                }
+                catch (const invalid_argument&) {
+                    fill(v[0].begin(), v[0].end(), 0.0);
+                }
+                for (size_t i = 0; i < steep->size(); ++i) {
+                    try {
+                        EuropeanOptionPrice option((*steep)[i], rate, carry, variance);
+                    }
+                    catch (const invalid_argument&) {
+                        v[1][i] = 0.0;
+                    }
+                }
+                return v;
+            }, 1e-12 });
+    }
+
+    // Digital payoffs on the European sample (cash and asset alternating), the
+    // in + out = vanilla parity of the barrier formulas (no rebate) and Haug's
+    // published barrier table, which checks every variant on its own
+    void AddDigitalAndBarrierEngines(vector<Engine>& engines, const Sample& s)
+    {
+        size_t n = s.contracts.size();
+        auto digitals = make_shared<vector<DigitalOptionParams>>();
+        vector<vector<real>> ref(3, vector<real>(n));
+        for (size_t i = 0; i < n; ++i) {
+            const OptionParams& p = s.contracts[i];
+            DigitalPayoff payoff = (i % 2) ? DigitalPayoff::AssetOrNothing : DigitalPayoff::CashOrNothing;
+            digitals->push_back({ p.S, p.K, p.T, p.r, p.sigma, p.b, p.optType, payoff, 1.0 });
+            Reference::Greeks g = Reference::Digital(p.S, p.K, p.T, p.r, p.sigma, p.b, p.optType == "C",
+                payoff == DigitalPayoff::CashOrNothing, 1.0L);
+            ref[0][i] = g.price;
+            ref[1][i] = g.delta;
+            ref[2][i] = g.gamma;
+        }
+
+        auto options = make_shared<vector<unique_ptr<OptionPrice>>>();
+        for (const DigitalOptionParams& p : *digitals)
+            options->push_back(make_unique<DigitalOptionPrice>(p));
+
+        engines.push_back({ "digital", "digital.scalar", { "price", "delta", "gamma" },
+            &kEuropeanScenarios, s.scenario, ref, [options, digitals]() {
+                size_t n = digitals->size();
+                vector<vector<double>> v(3, vector<double>(n));
+                for (size_t i = 0; i < n; ++i) {
+                    double S = (*digitals)[i].S;
+                    v[0][i] = (*options)[i]->Price(S);
+                    v[1][i] = (*options)[i]->Delta(S);
+                    v[2][i] = (*options)[i]->Gamma(S);
+                }
+                return v;
+            }, 1e-10 });
+
+        engines.push_back({ "digital", "digital.batch", { "price" },
+            &kEuropeanScenarios, s.scenario, { ref[0] }, [digitals]() {
+                return vector<vector<double>>{ PriceDigitalBatch(*digitals) };
+            }, 1e-10 });
+
+        // Down barriers below the spot and up barriers above it
+        auto barriers = make_shared<vector<BarrierOptionParams>>();
+        vector<vector<real>> parityRef(1, vector<real>(n));
+        mt19937 gen(7);
+        uniform_real_distribution<double> u(0.5, 0.99);
+        for (size_t i = 0; i < n; ++i) {
+            const OptionParams& p = s.contracts[i];
+            bool down = (i % 2) == 0;
+            double H = down ? p.S * u(gen) : p.S / u(gen);
+            barriers->push_back({ p.S, p.K, p.T, p.r, p.sigma, p.b, H, 0.0, p.optType,
+                down ? BarrierType::DownOut : BarrierType::UpOut });
+            parityRef[0][i] = Reference::European(p.S, p.K, p.T, p.r, p.sigma, p.b, p.optType == "C").price;
+        }
+        engines.push_back({ "barrier", "barrier.in_out_parity", { "in+out" },
+            &kEuropeanScenarios, s.scenario, parityRef, [barriers]() {
+                vector<BarrierPrices> all = AllBarrierVariants(*barriers);
+                vector<double> v(all.size());
+                for (size_t i = 0; i < all.size(); ++i) {
+                    const BarrierOptionParams& p = (*barriers)[i];
+                    bool call = p.optType == "C";
+                    if (p.barrier == BarrierType::DownOut)
+                        v[i] = call ? all[i].downInCall + all[i].downOutCall : all[i].downInPut + all[i].downOutPut;
+                    else
+                        v[i] = call ? all[i].upInCall + all[i].upOutCall : all[i].upInPut + all[i].upOutPut;
+                }
+                return vector<vector<double>>{ v };
+            }, 1e-9 });
+
+        // Haug, The Complete Guide to Option Pricing Formulas, table 4-13: S = 100,
+        // T = 0.5, r = 0.08, b = 0.04, rebate 3, for X = 90, 100, 110 at sigma 0.25
+        // and 0.30. The table has four decimals, so the gate allows 1.5e-4.
+        struct TableRow {
+            BarrierType type;
+            double H;
+            bool call;
+            double values[3][2];    // [X][sigma]
+        };
+        const TableRow table[] = {
+            { BarrierType::DownOut, 95.0, true, { { 9.0246, 8.8334 }, { 6.7924, 7.0285 }, { 4.8759, 5.4137 } } },
+            { BarrierType::DownOut, 100.0, true, { { 3.0000, 3.0000 }, { 3.0000, 3.0000 }, { 3.0000, 3.0000 } } },
+            { BarrierType::UpOut, 105.0, true, { { 2.6789, 2.6341 }, { 2.3580, 2.4389 }, { 2.3453, 2.4315 } } },
+            { BarrierType::DownIn, 95.0, true, { { 7.7627, 9.0093 }, { 4.0109, 5.1370 }, { 2.0576, 2.8517 } } },
+            { BarrierType::DownIn, 100.0, true, { { 13.8333, 14.8816 }, { 7.8494, 9.2045 }, { 3.9795, 5.3043 } } },
+            { BarrierType::UpIn, 105.0, true, { { 14.1112, 15.2098 }, { 8.4482, 9.7278 }, { 4.5910, 5.8350 } } },
+            { BarrierType::DownOut, 95.0, false, { { 2.2798, 2.4170 }, { 2.2947, 2.4258 }, { 2.6252, 2.6246 } } },
+            { BarrierType::DownOut, 100.0, false, { { 3.0000, 3.0000 }, { 3.0000, 3.0000 }, { 3.0000, 3.0000 } } },
+            { BarrierType::UpOut, 105.0, false, { { 3.7760, 4.2293 }, { 5.4932, 5.8032 }, { 7.5187, 7.5649 } } },
+            { BarrierType::DownIn, 95.0, false, { { 2.9586, 3.8769 }, { 6.5677, 7.7989 }, { 11.9752, 13.3078 } } },
+            { BarrierType::DownIn, 100.0, false, { { 2.2845, 3.3328 }, { 5.9085, 7.2636 }, { 11.6465, 12.9713 } } },
+            { BarrierType::UpIn, 105.0, false, { { 1.4653, 2.0658 }, { 3.3721, 4.4226 }, { 7.0846, 8.3686 } } },
+        };
+        const double strikes[] = { 90.0, 100.0, 110.0 };
+        const double vols[] = { 0.25, 0.30 };
+
+        auto tableOptions = make_shared<vector<unique_ptr<OptionPrice>>>();
+        vector<vector<real>> tableRef(1);
+        vector<int> tableScenario;
+        for (const TableRow& t : table) {
+            for (int k = 0; k < 3; ++k) {
+                for (int v = 0; v < 2; ++v) {
+                    BarrierOptionParams p{ 100.0, strikes[k], 0.5, 0.08, vols[v], 0.04, t.H, 3.0,
+                        t.call ? "C" : "P", t.type };
+                    tableOptions->push_back(make_unique<BarrierOptionPrice>(p));
+                    tableRef[0].push_back(t.values[k][v]);
+                    tableScenario.push_back(int(t.type));
+                }
+            }
+        }
+        Engine haug{ "barrier", "barrier.haug_table", { "price" },
+            &kBarrierTypeScenarios, tableScenario, tableRef, [tableOptions]() {
+                vector<double> v;
+                for (const auto& option : *tableOptions)
+                    v.push_back(option->Price(100.0));
+                return vector<vector<double>>{ v };
+            }, 1.5e-4 };
+        haug.relTolerance = 1e-4;
+        engines.push_back(haug);
+    }
+
+    string Sci(double x)
+    {
+        ostringstream out;
+        out << scientific << setprecision(2) << x;
+        return out.str();
+    }
+
+    void PrintRows(const vector<Row>& rows)
+    {
+        cout << left << setw(28) << "engine" << setw(8) << "value"
+            << right << setw(11) << "max abs" << setw(11) << "mean abs" << setw(11) << "max rel"
+            << setw(11) << "mean rel" << setw(11) << "max scaled" << setw(10) << "ns/item"
+            << setw(8) << "pareto" << setw(11) << "tolerance" << setw(7) << "gate" << "\n";
+
+        string family;
+        for (const Row& r : rows) {
+            if (r.family != family) {
+                cout << "-- " << r.family << "\n";
+                family = r.family;
+            }
+            cout << left << setw(28) << r.engine << setw(8) << r.quantity << right
+                << setw(11) << Sci(r.maxAbs) << setw(11) << Sci(r.meanAbs) << setw(11) << Sci(r.maxRel)
+                << setw(11) << Sci(r.meanRel) << setw(11) << Sci(r.maxScaled)
+                << setw(10) << fixed << setprecision(1) << r.nsPerItem
+                << setw(8) << (r.pareto ? "*" : "")
+                << setw(11) << (r.tolerance > 0.0 ? Sci(r.tolerance) : string("-"))
+                << setw(7) << (r.tolerance <= 0.0 ? "info" : r.pass ? "ok" : "FAIL");
+            if (r.nonFinite)
+                cout << "  (" << r.nonFinite << " non-finite)";
+            cout << "\n";
+        }
+    }
+
+    // Max scaled error per scenario, one table per scenario set
+    void PrintScenarios(const vector<Row>& rows)
+    {
+        for (const vector<string>* names : { &kEuropeanScenarios, &kPerpetualScenarios }) {
+            cout << "\nMax scaled error per scenario\n" << left << setw(36) << "engine / value" << right;
+            for (const string& sc : *names)
+                cout << setw(14) << sc;
+            cout << "\n";
+
+            for (const Row& r : rows) {
+                if (r.scenarioNames != names)
+                    continue;
+                cout << left << setw(36) << (r.engine + " " + r.quantity) << right;
+                for (double e : r.scenarioMaxScaled)
+                    cout << setw(14) << Sci(e);
+                cout << "\n";
+            }
+        }
+    }
+
+    void WriteCsv(const string& path, const vector<Row>& rows)
+    {
+        ofstream out(path);
+        out << "family,engine,quantity,items,non_finite,max_abs,mean_abs,max_rel,mean_rel,max_scaled,"
+            << "ns_per_item,pareto,tolerance,pass\n";
+        out << setprecision(6);
+        for (const Row& r : rows)
+            out << r.family << "," << r.engine << "," << r.quantity << "," << r.items << "," << r.nonFinite << ","
+                << r.maxAbs << "," << r.meanAbs << "," << r.maxRel << "," << r.meanRel << "," << r.maxScaled << ","
+                << r.nsPerItem << "," << (r.pareto ? 1 : 0) << "," << r.tolerance << "," << (r.pass ? 1 : 0) << "\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t samples = 1 << 14;
+    unsigned seed = 2024;
+    string csvPath;
+    bool gate = false;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto next = [&]() { return (i + 1 < argc) ? string(argv[++i]) : string(); };
+        if (arg == "--samples") samples = stoul(next());
+        else if (arg == "--seed") seed = static_cast<unsigned>(stoul(next()));
+        else if (arg == "--csv") csvPath = next();
+        else if (arg == "--gate") gate = true;
+        else {
+            cerr << "Usage: option_accuracy [--samples N] [--seed s] [--csv file] [--gate]\n";
+            return 2;
+        }
+    }
+
+    mt19937 gen(seed);
+    size_t blocks = max<size_t>(kEuropeanScenarios.size(), samples / kBlock);
+    Sample european = MakeEuropeanSample(blocks, gen);
+    Sample perpetual = MakePerpetualSample(blocks, gen);
+
+    vector<Engine> engines;
+    AddEuropeanEngines(engines, european);
+    AddGridEngines(engines);
+    AddDomainEngines(engines, european);
+    AddPerpetualEngines(engines, perpetual);
+    AddDigitalAndBarrierEngines(engines, european);
+
+    vector<Row> rows;
+    for (const Engine& e : engines) {
+        vector<Row> r = Evaluate(e, 3);
+        rows.insert(rows.end(), r.begin(), r.end());
+    }
+    MarkPareto(rows);
+
+    cout << "Accuracy against a long double reference (" << european.contracts.size() << " European and "
+        << perpetual.contracts.size() << " perpetual contracts, seed " << seed << ")\n"
+        << "scaled error = |v - ref| / max(1, |ref|); * = on the Pareto front of its value\n\n";
+    PrintRows(rows);
+    PrintScenarios(rows);
+
+    if (!csvPath.empty())
+        WriteCsv(csvPath, rows);
+
+    bool pass = all_of(rows.begin(), rows.end(), [](const Row& r) { return r.pass; });
+    cout << "\nGate: " << (pass ? "all engines within tolerance" : "FAILED") << "\n";
+    return (gate && !pass) ? 1 : 0;
+}
@@ -0,0 +1,269 @@
+// Adjoint.cpp
+#include "Adjoint.hpp"
+#include "AmericanOptionPrice.hpp"
+#include "CarryModels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+Arena::Arena(size_t blockSize)
+    : blockSize(blockSize), current(0), used(0)
+{
+}
+
+void* Arena::Allocate(size_t bytes, size_t align)
+{
+    for (;;) {
+        if (current < blocks.size()) {
+            size_t offset = (used + align - 1) / align * align;
+            if (offset + bytes <= sizes[current]) {
+                used = offset + bytes;
+                return blocks[current].get() + offset;
+            }
+            // Runs allocate in the same order, so a block skipped here is used again
+            // from the start after Reset()
+            if (used > 0 || current + 1 < blocks.size()) {
+                ++current;
+                used = 0;
+                continue;
+            }
+        }
+        size_t size = max(blockSize, bytes + align);
+        blocks.emplace_back(new char[size]);
+        sizes.push_back(size);
+        current = blocks.size() - 1;
+        used = 0;
+    }
+}
+
+void Arena::Reset()
+{
+    current = 0;
+    used = 0;
+}
+
+size_t Arena::Capacity() const
+{
+    size_t total = 0;
+    for (size_t s : sizes)
+        total += s;
+    return total;
+}
+
+Tape::Tape()
+    : arena(sizeof(Node) * kChunk * 8), size(0)
+{
+    Reset();
+}
+
+void Tape::NewChunk()
+{
+    chunks.push_back(arena.Allocate<Node>(kChunk));
+}
+
+void Tape::Reset()
+{
+    arena.Reset();
+    chunks.clear();
+    size = 0;
+    Push(0, 0.0, 0, 0.0);
+}
+
+ActiveDouble Tape::Input(double v)
+{
+    return ActiveDouble(v, Push(0, 0.0, 0, 0.0), this);
+}
+
+void Tape::Seed(const ActiveDouble& x, double w)
+{
+    if (x.tape == this)
+        At(x.index).adjoint += w;
+}
+
+void Tape::Sweep()
+{
+    for (uint32_t i = size; i-- > 1;) {
+        const Node& n = At(i);
+        if (n.adjoint == 0.0)
+            continue;
+        At(n.a).adjoint += n.da * n.adjoint;
+        At(n.b).adjoint += n.db * n.adjoint;
+    }
+}
+
+double Tape::Adjoint(const ActiveDouble& x)
+{
+    return x.tape == this ? At(x.index).adjoint : 0.0;
+}
+
+ActiveDouble exp(const ActiveDouble& x)
+{
+    double e = std::exp(x.value);
+    return Record(x, e, e);
+}
+
+ActiveDouble log(const ActiveDouble& x)
+{
+    return Record(x, std::log(x.value), 1.0 / x.value);
+}
+
+ActiveDouble sqrt(const ActiveDouble& x)
+{
+    double s = std::sqrt(x.value);
+    return Record(x, s, 0.5 / s);
+}
+
+ActiveDouble CumNormal(const ActiveDouble& x)
+{
+    const double kInvSqrt2 = 0.70710678118654752440;
+    const double kInvSqrt2Pi = 0.39894228040143267794;
+    return Record(x, 0.5 * std::erfc(-x.value * kInvSqrt2), kInvSqrt2Pi * std::exp(-0.5 * x.value * x.value));
+}
+
+namespace {
+
+    // Both axes need at least one bucket and strictly ascending edges, and every
+    // bucket its market value; Bucket() relies on it
+    void Validate(const AdjointMarket& m, const string& caller)
+    {
+        if (m.expiries.empty() || m.strikes.empty())
+            throw invalid_argument(caller + ": the expiry and strike axes need at least one bucket");
+        for (const vector<double>* edges : { &m.expiries, &m.strikes })
+            for (size_t i = 1; i < edges->size(); ++i)
+                if (!((*edges)[i] > (*edges)[i - 1]))
+                    throw invalid_argument(caller + ": bucket edges must be strictly increasing");
+        if (m.rates.size() != m.expiries.size() || m.carries.size() != m.expiries.size())
+            throw invalid_argument(caller + ": need one rate and one carry per expiry bucket");
+        if (m.vols.size() != m.expiries.size() * m.strikes.size())
+            throw invalid_argument(caller + ": need one volatility per expiry and strike bucket");
+    }
+
+    size_t Bucket(const vector<double>& edges, double x)
+    {
+        size_t i = size_t(lower_bound(edges.begin(), edges.end(), x) - edges.begin());
+        return min(i, edges.size() - 1);
+    }
+
+    // Expiry and volatility bucket of a position
+    void Buckets(const Position& p, const AdjointMarket& m, size_t& expiry, size_t& vol)
+    {
+        expiry = p.perpetual ? m.expiries.size() - 1 : Bucket(m.expiries, p.contract.T);
+        vol = expiry * m.strikes.size() + Bucket(m.strikes, p.contract.K);
+    }
+
+    // The generalized Black-Scholes price of EuropeanOptionPrice
+    ActiveDouble European(const ActiveDouble& S, double K, double T, const ActiveDouble& r,
+        const ActiveDouble& sigma, const ActiveDouble& b, bool call)
+    {
+        double w = call ? 1.0 : -1.0;
+        ActiveDouble sigmaSqrtT = sigma * sqrt(T);
+        ActiveDouble d1 = (log(S / K) + (b + 0.5 * sigma * sigma) * T) / sigmaSqrtT;
+        ActiveDouble d2 = d1 - sigmaSqrtT;
+        ActiveDouble carry = exp((b - r) * T);
+        ActiveDouble discount = exp(-r * T);
+        return w * (S * carry * CumNormal(w * d1) - K * discount * CumNormal(w * d2));
+    }
+
+    // The perpetual price of AmericanOptionPrice, K / |y - 1| ((y - 1) / y S / K)^y
+    ActiveDouble Perpetual(const ActiveDouble& S, double K, const ActiveDouble& r,
+        const ActiveDouble& sigma, const ActiveDouble& b, bool call)
+    {
+        ActiveDouble s2 = sigma * sigma;
+        ActiveDouble tmp = b / s2;
+        ActiveDouble D = sqrt((tmp - 0.5) * (tmp - 0.5) + 2.0 * r / s2);
+        ActiveDouble y = call ? 0.5 - tmp + D : 0.5 - tmp - D;
+        ActiveDouble scale = call ? K / (y - 1.0) : K / (1.0 - y);
+        return scale * exp(y * log((y - 1.0) / y * (S / K)));
+    }
+}
+
+PortfolioSensitivities AdjointPortfolio::Sensitivities(const vector<Position>& book, const AdjointMarket& market)
+{
+    Validate(market, "AdjointPortfolio::Sensitivities");
+    tape.Reset();
+
+    size_t ne = market.expiries.size();
+    vector<ActiveDouble> rates(ne), carries(ne), vols(market.vols.size());
+    for (size_t i = 0; i < ne; ++i) {
+        rates[i] = tape.Input(market.rates[i]);
+        carries[i] = tape.Input(market.carries[i]);
+    }
+    for (size_t i = 0; i < vols.size(); ++i)
+        vols[i] = tape.Input(market.vols[i]);
+
+    PortfolioSensitivities out;
+    vector<ActiveDouble> spots(book.size());
+    for (size_t i = 0; i < book.size(); ++i) {
+        const Position& p = book[i];
+        size_t e, v;
+        Buckets(p, market, e, v);
+
+        spots[i] = tape.Input(p.contract.S);
+        bool call = p.contract.optType == "C";
+        ActiveDouble price = p.perpetual
+            ? Perpetual(spots[i], p.contract.K, rates[e], vols[v], carries[e], call)
+            : European(spots[i], p.contract.K, p.contract.T, rates[e], vols[v], carries[e], call);
+
+        out.value += p.quantity * price.value;
+        tape.Seed(price, p.quantity);
+    }
+
+    tape.Sweep();
+
+    out.rates.resize(ne);
+    out.carries.resize(ne);
+    for (size_t i = 0; i < ne; ++i) {
+        out.rates[i] = tape.Adjoint(rates[i]);
+        out.carries[i] = tape.Adjoint(carries[i]);
+    }
+    out.vols.resize(vols.size());
+    for (size_t i = 0; i < vols.size(); ++i)
+        out.vols[i] = tape.Adjoint(vols[i]);
+    out.spots.resize(book.size());
+    for (size_t i = 0; i < book.size(); ++i)
+        out.spots[i] = tape.Adjoint(spots[i]);
+    return out;
+}
+
+size_t AdjointPortfolio::TapeNodes() const
+{
+    return tape.Nodes();
+}
+
+size_t AdjointPortfolio::TapeBytes() const
+{
+    return tape.Bytes();
+}
+
+double PortfolioValue(const vector<Position>& book, const AdjointMarket& market)
+{
+    Validate(market, "PortfolioValue");
+    vector<OptionParams> europeans;
+    vector<double> quantities;
+    double value = 0.0;
+    for (const Position& p : book) {
+        size_t e, v;
+        Buckets(p, market, e, v);
+        double r = market.rates[e], b = market.carries[e], sigma = market.vols[v];
+
+        if (p.perpetual) {
+            AmericanOptionPrice option(PerpetualOptionParams(p.contract.S, p.contract.K, 0.0, sigma, r, b, p.contract.optType));
+            value += p.quantity * option.Price(p.contract.S);
+        }
+        else {
+            OptionParams c = p.contract;
+            c.r = r;
+            c.b = b;
+            c.sigma = sigma;
+            c.model = CarryModel::Generic;
+            europeans.push_back(c);
+            quantities.push_back(p.quantity);
+        }
+    }
+
+    vector<EuropeanResult> res = PriceEuropeanBatch(europeans);
+    for (size_t i = 0; i < res.size(); ++i)
+        value += quantities[i] * res[i].price;
+    return value;
+}
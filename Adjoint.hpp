@@ -0,0 +1,190 @@
+// Adjoint.hpp
+// Reverse-mode (adjoint) sensitivities of a book of European and perpetual American
+// options to the market inputs it shares: r and b per expiry bucket and sigma per
+// (expiry, strike) bucket. One recording pass writes every elementary operation of
+// the kernels to a tape, then one reverse sweep over the tape yields the derivative
+// of the book value with respect to all inputs at once. The cost is a small multiple
+// of one pricing pass however many inputs there are, where bumping costs one pass per
+// input.
+//
+// The tape lives in an arena: its chunks are kept when the tape is reset, so after
+// the first run a book of the same size records without allocating.
+
+#ifndef Adjoint_HPP
+#define Adjoint_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Parameters.hpp"
+
+using namespace std;
+
+// Bump allocator over a list of blocks. Reset() rewinds to the first block without
+// releasing memory.
+class Arena
+{
+private:
+    vector<unique_ptr<char[]>> blocks;
+    vector<size_t> sizes;
+    size_t blockSize;
+    size_t current;     // block being filled
+    size_t used;        // bytes used in it
+
+public:
+    explicit Arena(size_t blockSize = 1 << 20);
+
+    void* Allocate(size_t bytes, size_t align);
+
+    template <typename T>
+    T* Allocate(size_t n) { return static_cast<T*>(Allocate(n * sizeof(T), alignof(T))); }
+
+    void Reset();
+    size_t Capacity() const;    // bytes held
+};
+
+class Tape;
+
+// A double recorded on a tape. Constants have no tape and cost nothing to record.
+struct ActiveDouble {
+    double value;
+    uint32_t index;     // node on the tape (0 for constants)
+    Tape* tape;
+
+    ActiveDouble(double v = 0.0) : value(v), index(0), tape(nullptr) {}
+    ActiveDouble(double v, uint32_t i, Tape* t) : value(v), index(i), tape(t) {}
+};
+
+class Tape
+{
+private:
+    // Result of one operation: the indices of its (at most two) arguments with the
+    // partial derivatives, and the adjoint filled in by the sweep
+    struct Node {
+        double adjoint;
+        double da;
+        double db;
+        uint32_t a;
+        uint32_t b;
+    };
+
+    static constexpr uint32_t kChunkShift = 14;
+    static constexpr uint32_t kChunk = 1u << kChunkShift;
+
+    Arena arena;
+    vector<Node*> chunks;
+    uint32_t size;
+
+    Node& At(uint32_t i) { return chunks[i >> kChunkShift][i & (kChunk - 1)]; }
+    void NewChunk();
+
+public:
+    Tape();
+
+    // Empties the tape; node 0 is the sink of constant arguments
+    void Reset();
+
+    ActiveDouble Input(double v);
+
+    uint32_t Push(uint32_t a, double da, uint32_t b, double db)
+    {
+        if ((size & (kChunk - 1)) == 0)
+            NewChunk();
+        At(size) = { 0.0, da, db, a, b };
+        return size++;
+    }
+
+    // Adds w to the adjoint of x before the sweep (x enters the output with weight w)
+    void Seed(const ActiveDouble& x, double w);
+    // Propagates the seeded adjoints back to the inputs
+    void Sweep();
+    double Adjoint(const ActiveDouble& x);
+
+    size_t Nodes() const { return size; }
+    size_t Bytes() const { return arena.Capacity(); }
+};
+
+inline Tape* TapeOf(const ActiveDouble& x, const ActiveDouble& y)
+{
+    return x.tape ? x.tape : y.tape;
+}
+
+// f(x) with f'(x) = d
+inline ActiveDouble Record(const ActiveDouble& x, double f, double d)
+{
+    if (!x.tape)
+        return ActiveDouble(f);
+    return ActiveDouble(f, x.tape->Push(x.index, d, 0, 0.0), x.tape);
+}
+
+// f(x, y) with partials dx and dy
+inline ActiveDouble Record(const ActiveDouble& x, const ActiveDouble& y, double f, double dx, double dy)
+{
+    Tape* t = TapeOf(x, y);
+    if (!t)
+        return ActiveDouble(f);
+    return ActiveDouble(f, t->Push(x.index, dx, y.index, dy), t);
+}
+
+inline ActiveDouble operator + (const ActiveDouble& x, const ActiveDouble& y) { return Record(x, y, x.value + y.value, 1.0, 1.0); }
+inline ActiveDouble operator - (const ActiveDouble& x, const ActiveDouble& y) { return Record(x, y, x.value - y.value, 1.0, -1.0); }
+inline ActiveDouble operator * (const ActiveDouble& x, const ActiveDouble& y) { return Record(x, y, x.value * y.value, y.value, x.value); }
+inline ActiveDouble operator / (const ActiveDouble& x, const ActiveDouble& y)
+{
+    double q = x.value / y.value;
+    return Record(x, y, q, 1.0 / y.value, -q / y.value);
+}
+inline ActiveDouble operator - (const ActiveDouble& x) { return Record(x, -x.value, -1.0); }
+
+ActiveDouble exp(const ActiveDouble& x);
+ActiveDouble log(const ActiveDouble& x);
+ActiveDouble sqrt(const ActiveDouble& x);
+ActiveDouble CumNormal(const ActiveDouble& x);     // N(x)
+
+// Market inputs shared by the book. A contract belongs to the first bucket whose
+// edge is >= its expiry (strike), or to the last bucket; perpetuals use the last
+// expiry bucket. Sensitivities and PortfolioValue throw invalid_argument
+// when an axis is empty or not strictly ascending, or a value is missing.
+struct AdjointMarket {
+    vector<double> expiries;    // expiry bucket edges, ascending
+    vector<double> rates;       // r per expiry bucket
+    vector<double> carries;     // b per expiry bucket
+    vector<double> strikes;     // strike bucket edges, ascending
+    vector<double> vols;        // sigma per [expiry bucket][strike bucket]
+};
+
+// contract.r, .b and .sigma are ignored (they come from the market); T is ignored
+// for perpetuals
+struct Position {
+    OptionParams contract;
+    double quantity = 1.0;
+    bool perpetual = false;
+};
+
+struct PortfolioSensitivities {
+    double value = 0.0;
+    vector<double> rates;       // dV/dr per expiry bucket
+    vector<double> carries;     // dV/db per expiry bucket
+    vector<double> vols;        // dV/dsigma per [expiry bucket][strike bucket]
+    vector<double> spots;       // dV/dS per position (quantity times delta)
+};
+
+class AdjointPortfolio
+{
+private:
+    Tape tape;
+
+public:
+    // Records the book on the tape (reset first), then sweeps it once
+    PortfolioSensitivities Sensitivities(const vector<Position>& book, const AdjointMarket& market);
+
+    size_t TapeNodes() const;
+    size_t TapeBytes() const;
+};
+
+// Value of the book through PriceEuropeanBatch and AmericanOptionPrice::Price: one
+// plain pricing pass, which bumping repeats for every input
+double PortfolioValue(const vector<Position>& book, const AdjointMarket& market);
+
+#endif // Adjoint_HPP
@@ -2,10 +2,26 @@
 #include "AmericanOptionPrice.hpp"
 #include <cmath>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <vector>
 //#include "Parameters.hpp"
+#include "Instrumentation.hpp"
+#include "Scheduler.hpp"
 using namespace std;
 
+namespace {
+
+	// A call whose exponent is within this of 1 (b = r) is never exercised, and
+	// K / (y1 - 1) * 0^1 is replaced by its limit U
+	const double kUnitExponent = 1e-12;
+
+	bool UnitExponent(double y)
+	{
+		return fabs(y - 1.0) <= kUnitExponent;
+	}
+}
+
 AmericanOptionPrice::AmericanOptionPrice() {
 
 	init();
@@ -14,14 +30,15 @@ AmericanOptionPrice::AmericanOptionPrice() {
 
 double AmericanOptionPrice::N(double x) const
 {
-	// Cumulative standard normal distribution using the error function
-	return 0.5 * (1.0 + std::erf(x / std::sqrt(2.0)));
+	// Cumulative standard normal distribution using the complementary error function
+	// (1 + erf(x) cancels in the left tail, which loses the deep OTM prices)
+	return 0.5 * std::erfc(-x / std::sqrt(2.0));
 }
 
 double AmericanOptionPrice::n(double x) const
 {
 
-	double A = 1.0 / sqrt(2.0 * 3.1415);
+	const double A = 0.39894228040143267794;	// 1 / sqrt(2 pi)
 	return A * exp(-x * x * 0.5);
 
 }
@@ -75,6 +92,8 @@ double AmericanOptionPrice::CallPrice(double U) const {
 	double d = (tmp - 0.5) * (tmp - 0.5);
 
 	double y1 = 0.5 - tmp + sqrt(d + ((2 * r) / (sigma * sigma)));
+	if (UnitExponent(y1))
+		return U;
 
 	double term1 = K / (y1 - 1);
 	double term2 = std::pow(((y1 - 1) / y1) * (U / K), y1);
@@ -96,56 +115,169 @@ double AmericanOptionPrice::PutPrice(double U) const {
 
 double AmericanOptionPrice::Price(double U) const
 {
+	INSTRUMENT_CALL(Kernel::AmericanPrice);
+	INSTRUMENT_DOMAIN(Kernel::AmericanPrice, sigma <= 0.0 || U <= 0.0);
+
+	double price;
 	if (optType == "C")
 	{
 		//cout << "calling call\n";
-		return CallPrice(U);
+		price = CallPrice(U);
 	}
 	else
 	{
 		//cout << "calling put\n";
-		return PutPrice(U);
+		price = PutPrice(U);
 	}
+
+	INSTRUMENT_RESULT(Kernel::AmericanPrice, price);
+	return price;
 }
 
 
-double AmericanOptionPrice::CallDelta(double U) const
+// The perpetual price is V = K / |y - 1| * x^y with x = ((y - 1) / y) * (U / K),
+// where y = y1 for calls and y = y2 for puts. Hence dV/dU = y * V / U,
+// d2V/dU2 = y * (y - 1) * V / U^2 and dV/dy = V * ln(x); vega and rho follow
+// from the chain rule through y(sigma, r). The carry b is held fixed.
+PerpetualExponent AmericanOptionPrice::Exponent() const
 {
-	double tmp = sigma * sqrt(T);
+	double s2 = sigma * sigma;
+	double tmp = b / s2;
+	double D = sqrt((tmp - 0.5) * (tmp - 0.5) + (2 * r) / s2);
+	double sgn = (optType == "C") ? 1.0 : -1.0;
 
-	double d1 = (log(U / K) + (b + (sigma * sigma) * 0.5) * T) / tmp;
+	PerpetualExponent e;
+	e.y = 0.5 - tmp + sgn * D;
 
+	double dD_dsigma = -2.0 * ((tmp - 0.5) * b + r) / (s2 * sigma * D);
+	e.dy_dsigma = 2.0 * b / (s2 * sigma) + sgn * dD_dsigma;
+	e.dy_dr = sgn / (s2 * D);
 
-	return exp((b - r) * T) * N(d1);
+	return e;
 }
 
-double AmericanOptionPrice::PutDelta(double U) const
+PerpetualGreeks AmericanOptionPrice::Evaluate(double U, const PerpetualExponent& e, double strike)
 {
-	double tmp = sigma * sqrt(T);
+	double y = e.y;
+	PerpetualGreeks g;
+	if (UnitExponent(y)) {
+		// The same limit as GreeksBatch; rho is one-sided (b > r has no finite value)
+		g.price = U;
+		g.delta = 1.0;
+		g.gamma = 0.0;
+		g.vega = 0.0;
+		g.rho = numeric_limits<double>::quiet_NaN();
+		return g;
+	}
+
+	double lnx = log(((y - 1) / y) * (U / strike));
 
-	double d1 = (log(U / K) + (b + (sigma * sigma) * 0.5) * T) / tmp;
+	g.price = strike / abs(y - 1) * exp(y * lnx);
+	g.delta = y * g.price / U;
+	g.gamma = y * (y - 1) * g.price / (U * U);
+	g.vega = g.price * lnx * e.dy_dsigma;
+	g.rho = g.price * lnx * e.dy_dr;
 
-	return exp((b - r) * T) * (N(d1) - 1.0);
+	return g;
 }
 
-double AmericanOptionPrice::PutCallGamma(double U) const
+PerpetualGreeks AmericanOptionPrice::Greeks(double U) const
 {
+	INSTRUMENT_CALL(Kernel::AmericanGreeks);
+	INSTRUMENT_DOMAIN(Kernel::AmericanGreeks, sigma <= 0.0 || U <= 0.0);
+
+	PerpetualGreeks g = Evaluate(U, Exponent(), K);
+
+	INSTRUMENT_RESULT(Kernel::AmericanGreeks, g.price);
+	return g;
+}
 
-	double tmp = sigma * sqrt(T);
+double AmericanOptionPrice::Vega(double U) const
+{
+	return Greeks(U).vega;
+}
 
-	double d1 = (log(U / K) + (b + (sigma * sigma) * 0.5) * T) / tmp;
+double AmericanOptionPrice::Rho(double U) const
+{
+	return Greeks(U).rho;
+}
 
-	return (n(d1) * exp((b - r) * T)) / (U * tmp);
+vector<PerpetualGreeks> AmericanOptionPrice::GreeksBatch(const vector<double>& spots,
+	const vector<double>& strikes, double r, double sigma, double b, const string& optType, BatchDomain* domain)
+{
+	if (spots.size() != strikes.size())
+		throw invalid_argument("GreeksBatch: spots and strikes differ in size");
+
+	// The exponent only depends on (r, sigma, b), so it is computed once for the whole batch
+	bool badVol = !(sigma > 0.0);
+	AmericanOptionPrice option(PerpetualOptionParams(0.0, 0.0, 0.0, badVol ? 1.0 : sigma, r, b, optType));
+	PerpetualExponent e = option.Exponent();
+
+	// A call with y1 = 1 (b = r) is never exercised: the formula's limit is U. With
+	// y1 < 1 (b > r) there is no finite value. Both are evaluated on y = 2 and blended.
+	bool call = optType == "C";
+	bool unit = call && UnitExponent(e.y);
+	bool badExponent = badVol || (call && e.y < 1.0 - kUnitExponent);
+	PerpetualExponent safe = e;
+	safe.y = (unit || badExponent) ? 2.0 : e.y;
+
+	size_t n = spots.size();
+	INSTRUMENT_BATCH(Kernel::AmericanGreeks, n);
+
+	if (domain)
+		domain->Reset(n);
+	const double nan = numeric_limits<double>::quiet_NaN();
+	vector<PerpetualGreeks> result(n);
+	ParallelRows(n, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			bool invalid = badExponent || InvalidInputs(spots[i], strikes[i], r, sigma, b);
+			double U = invalid ? 1.0 : spots[i];
+			PerpetualGreeks g = Evaluate(U, safe, invalid ? 1.0 : strikes[i]);
+
+			g.price = unit ? U : g.price;
+			g.delta = unit ? 1.0 : g.delta;
+			g.gamma = unit ? 0.0 : g.gamma;
+			g.vega = unit ? 0.0 : g.vega;
+			g.rho = unit ? nan : g.rho;		// one-sided: b > r has no finite value
+
+			g.price = invalid ? nan : g.price;
+			g.delta = invalid ? nan : g.delta;
+			g.gamma = invalid ? nan : g.gamma;
+			g.vega = invalid ? nan : g.vega;
+			g.rho = invalid ? nan : g.rho;
+			result[i] = g;
+
+			if (domain)
+				domain->Set(i, uint8_t(invalid ? DomainInvalid : (unit ? DomainPerpetualUnit : DomainOk)));
+		}
+	});
+	if (domain)
+		domain->Finish();
+	return result;
 }
 
 double AmericanOptionPrice::Delta(double U) const {
-	if (optType == "C")
-		return CallDelta(U);
-	else
-		return PutDelta(U);
+	INSTRUMENT_CALL(Kernel::AmericanDelta);
+	INSTRUMENT_DOMAIN(Kernel::AmericanDelta, sigma <= 0.0 || U <= 0.0);
+
+	double delta = Evaluate(U, Exponent(), K).delta;
+
+	INSTRUMENT_RESULT(Kernel::AmericanDelta, delta);
+	return delta;
 }
 
 double AmericanOptionPrice::Gamma(double U) const {
-	return PutCallGamma(U);
+	INSTRUMENT_CALL(Kernel::AmericanGamma);
+	INSTRUMENT_DOMAIN(Kernel::AmericanGamma, sigma <= 0.0 || U <= 0.0);
+
+	double gamma = Evaluate(U, Exponent(), K).gamma;
+
+	INSTRUMENT_RESULT(Kernel::AmericanGamma, gamma);
+	return gamma;
 }
 
+// Closed form without CDFs
+double AmericanOptionPrice::CostHint() const
+{
+	return 0.7;
+}
@@ -4,12 +4,29 @@
 
 #include <iostream>
 #include <string>
+#include "Domain.hpp"
 #include "Parameters.hpp"
 #include "OptionPrice.hpp"
 #include <vector>
 #include <cmath>
 
 
+// Perpetual price and its sensitivities, computed in one pass
+struct PerpetualGreeks {
+    double price;
+    double delta;   // dV/dS
+    double gamma;   // d2V/dS2
+    double vega;    // dV/dsigma
+    double rho;     // dV/dr (cost of carry b held fixed)
+};
+
+// Exponent of the perpetual price (y1 for calls, y2 for puts) and its derivatives
+struct PerpetualExponent {
+    double y;
+    double dy_dsigma;
+    double dy_dr;
+};
+
 class AmericanOptionPrice : public OptionPrice
 {
 private:
@@ -20,10 +37,9 @@ private:
     double N(double x) const;
     double n(double x) const;
 
-    double CallDelta(double U) const;
-    double PutDelta(double U) const;
-
-    double PutCallGamma(double U) const;
+    PerpetualExponent Exponent() const;
+    // A call with y1 = 1 (b = r) gets the limit of GreeksBatch: price U, delta 1
+    static PerpetualGreeks Evaluate(double U, const PerpetualExponent& e, double strike);
 
 public:
     AmericanOptionPrice();
@@ -36,6 +52,18 @@ public:
 
     double Delta(double U) const override;
     double Gamma(double U) const override;
+    double CostHint() const override;
+    double Vega(double U) const;
+    double Rho(double U) const;
+
+    PerpetualGreeks Greeks(double U) const;
+
+    // Price and Greeks for each (spots[i], strikes[i]) pair sharing r, sigma and b.
+    // Rows outside the domain are blended to their limits (see Domain.hpp). Throws
+    // invalid_argument if spots and strikes differ in size.
+    static vector<PerpetualGreeks> GreeksBatch(const vector<double>& spots,
+        const vector<double>& strikes, double r, double sigma, double b, const string& optType,
+        BatchDomain* domain = nullptr);
 
 };
 #endif
\ No newline at end of file
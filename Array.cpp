@@ -1,10 +1,18 @@
 
 #include "Array.hpp"
+#include <cmath>
 
 vector<double> GenerateMeshArray(double start, double end, double step) {
     vector<double> mesh;
-    for (double val = start; val <= end; val += step) {
-        mesh.push_back(val);
+    if (!(step > 0.0) || end < start)
+        return mesh;
+
+    // The relative slack keeps an end point that is a whole number of steps away
+    // but not exactly representable, e.g. 0.0 to 1.0 by 0.1
+    size_t count = size_t(floor((end - start) / step * (1.0 + 1e-12))) + 1;
+    mesh.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        mesh.push_back(start + double(i) * step);
     }
     return mesh;
 }
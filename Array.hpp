@@ -5,6 +5,8 @@
 #include <vector>
 using namespace std;
 
+// start, start + step, ... up to end included. Each point is start + i * step, so
+// long meshes do not accumulate the rounding of a running sum.
 vector<double> GenerateMeshArray(double start, double end, double step);
 
 #endif // UTILS_HPP
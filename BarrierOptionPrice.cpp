@@ -0,0 +1,391 @@
+
+#include "BarrierOptionPrice.hpp"
+#include "Instrumentation.hpp"
+#include "Scheduler.hpp"
+#include <algorithm>
+#include <cmath>
+
+BarrierOptionPrice::BarrierOptionPrice() {
+	init();
+}
+
+BarrierOptionPrice::BarrierOptionPrice(const BarrierOptionParams& p) {
+	K = p.K;
+	T = p.T;
+	r = p.r;
+	sigma = p.sigma;
+	b = p.b;
+	optType = p.optType;
+	S = p.S;
+	H = p.H;
+	rebate = p.rebate;
+	barrier = p.barrier;
+}
+
+BarrierOptionPrice::~BarrierOptionPrice() {}
+
+void BarrierOptionPrice::init()
+{	// Initialise all default values
+	r = 0.05;
+	sigma = 0.2;
+	K = 100.0;
+	T = 1;
+	b = r;
+	optType = "C";
+	H = 90.0;
+	rebate = 0.0;
+	barrier = BarrierType::DownOut;
+}
+
+// Kernel Functions (Haug: standard barrier options, Reiner and Rubinstein 1991)
+BarrierTerms BarrierOptionPrice::Terms(double U, double K, double H, double T, double r, double sigma, double b)
+{
+	const double invSqrt2 = 0.70710678118654752440;
+	auto N = [invSqrt2](double x) { return CdfPair{ 0.5 * erfc(-x * invSqrt2), 0.5 * erfc(x * invSqrt2) }; };
+
+	double s2 = sigma * sigma;
+	double mu = (b - 0.5 * s2) / s2;
+	double lambda = sqrt(mu * mu + 2.0 * r / s2);
+
+	BarrierTerms t;
+	t.spot = U;
+	t.sigmaSqrtT = sigma * sqrt(T);
+	t.discount = exp(-r * T);
+	t.spotCarry = U * exp((b - r) * T);
+	t.strikeDiscount = K * t.discount;
+
+	// ln(H^2 / (S X)) = ln(S/X) - 2 ln(S/H) and ln(H/S) = -ln(S/H)
+	double lnSX = log(U / K);
+	double lnSH = log(U / H);
+	double shift = (1.0 + mu) * t.sigmaSqrtT;
+	double sst = t.sigmaSqrtT;
+
+	double x1 = lnSX / sst + shift;
+	double x2 = lnSH / sst + shift;
+	double y1 = (lnSX - 2.0 * lnSH) / sst + shift;
+	double y2 = -lnSH / sst + shift;
+	double z = -lnSH / sst + lambda * sst;
+
+	t.Nx1 = N(x1);
+	t.Nx1s = N(x1 - sst);
+	t.Nx2 = N(x2);
+	t.Nx2s = N(x2 - sst);
+	t.Ny1 = N(y1);
+	t.Ny1s = N(y1 - sst);
+	t.Ny2 = N(y2);
+	t.Ny2s = N(y2 - sst);
+	t.Nz = N(z);
+	t.Nzs = N(z - 2.0 * lambda * sst);
+
+	t.mu = mu;
+	t.lambda = lambda;
+	t.x1 = x1;
+	t.x2 = x2;
+	t.y1 = y1;
+	t.y2 = y2;
+	t.z = z;
+
+	t.hs2mu1 = exp(-2.0 * (mu + 1.0) * lnSH);
+	t.hs2mu = exp(-2.0 * mu * lnSH);
+	t.hsMuPlusLambda = exp(-(mu + lambda) * lnSH);
+	t.hsMuMinusLambda = exp(-(mu - lambda) * lnSH);
+
+	t.strikeAboveBarrier = K > H;
+	t.downHit = U <= H;
+	t.upHit = U >= H;
+	return t;
+}
+
+namespace {
+
+	// A value with its first and second derivative in the spot. Sums and products
+	// follow the product rule, so the combination of A..F below gives delta and
+	// gamma from the same code as the price.
+	struct Jet {
+		double v, d, dd;
+		Jet(double value = 0.0, double first = 0.0, double second = 0.0) : v(value), d(first), dd(second) {}
+	};
+
+	inline Jet operator + (const Jet& a, const Jet& b) { return Jet(a.v + b.v, a.d + b.d, a.dd + b.dd); }
+	inline Jet operator - (const Jet& a, const Jet& b) { return Jet(a.v - b.v, a.d - b.d, a.dd - b.dd); }
+	inline Jet operator * (const Jet& a, const Jet& b)
+	{
+		return Jet(a.v * b.v, a.d * b.v + a.v * b.d, a.dd * b.v + 2.0 * a.d * b.d + a.v * b.dd);
+	}
+
+	inline bool IsZero(double x) { return x == 0.0; }
+	inline bool IsZero(const Jet& x) { return x.v == 0.0 && x.d == 0.0 && x.dd == 0.0; }
+
+	struct JetPair {
+		Jet pos;
+		Jet neg;
+	};
+
+	// BarrierTerms as jets; the field names match, so Combine reads either
+	struct BarrierJets {
+		Jet spotCarry;
+		Jet strikeDiscount;
+		double discount;
+		JetPair Nx1, Nx1s, Nx2, Nx2s, Ny1, Ny1s, Ny2, Ny2s, Nz, Nzs;
+		Jet hs2mu1, hs2mu, hsMuPlusLambda, hsMuMinusLambda;
+		bool strikeAboveBarrier, downHit, upHit;
+	};
+
+	// N(a) and N(-a) for a = alpha ln S + c: N' = n(a) alpha / S and
+	// N'' = n(a) alpha (-a alpha - 1) / S^2
+	JetPair CdfJets(const CdfPair& N, double a, double alpha, double U)
+	{
+		const double invSqrt2Pi = 0.39894228040143267794;
+		double n = invSqrt2Pi * exp(-0.5 * a * a);
+		double d = n * alpha / U;
+		double dd = n * alpha * (-a * alpha - 1.0) / (U * U);
+		return { Jet(N.pos, d, dd), Jet(N.neg, -d, -dd) };
+	}
+
+	// (H/S)^k: derivatives -k p / S and k (k + 1) p / S^2
+	Jet PowerJet(double p, double k, double U)
+	{
+		return Jet(p, -k * p / U, k * (k + 1.0) * p / (U * U));
+	}
+
+	BarrierJets Jets(const BarrierTerms& t, double U)
+	{
+		double sst = t.sigmaSqrtT;
+		double up = 1.0 / sst, down = -1.0 / sst;
+
+		BarrierJets j;
+		j.spotCarry = Jet(t.spotCarry, t.spotCarry / U, 0.0);
+		j.strikeDiscount = Jet(t.strikeDiscount);
+		j.discount = t.discount;
+		j.Nx1 = CdfJets(t.Nx1, t.x1, up, U);
+		j.Nx1s = CdfJets(t.Nx1s, t.x1 - sst, up, U);
+		j.Nx2 = CdfJets(t.Nx2, t.x2, up, U);
+		j.Nx2s = CdfJets(t.Nx2s, t.x2 - sst, up, U);
+		j.Ny1 = CdfJets(t.Ny1, t.y1, down, U);
+		j.Ny1s = CdfJets(t.Ny1s, t.y1 - sst, down, U);
+		j.Ny2 = CdfJets(t.Ny2, t.y2, down, U);
+		j.Ny2s = CdfJets(t.Ny2s, t.y2 - sst, down, U);
+		j.Nz = CdfJets(t.Nz, t.z, down, U);
+		j.Nzs = CdfJets(t.Nzs, t.z - 2.0 * t.lambda * sst, down, U);
+		j.hs2mu1 = PowerJet(t.hs2mu1, 2.0 * (t.mu + 1.0), U);
+		j.hs2mu = PowerJet(t.hs2mu, 2.0 * t.mu, U);
+		j.hsMuPlusLambda = PowerJet(t.hsMuPlusLambda, t.mu + t.lambda, U);
+		j.hsMuMinusLambda = PowerJet(t.hsMuMinusLambda, t.mu - t.lambda, U);
+		j.strikeAboveBarrier = t.strikeAboveBarrier;
+		j.downHit = t.downHit;
+		j.upHit = t.upHit;
+		return j;
+	}
+
+	// The variants as combinations of A..F, over BarrierTerms (V = double) or
+	// BarrierJets (V = Jet)
+	template <typename V, typename Terms>
+	V Combine(const Terms& t, BarrierType type, bool call, double rebate)
+	{
+		// N(sign * x) from the stored pair
+		auto Ns = [](double sign, const decltype(t.Nx1)& Nx) { return sign > 0.0 ? Nx.pos : Nx.neg; };
+		// (H/S)^a * N(.): at low volatility the power overflows exactly where the CDF
+		// underflows, and the product is 0 rather than inf * 0
+		auto Pw = [](const V& power, const V& Nx) { return IsZero(Nx) ? V(0.0) : power * Nx; };
+
+		double phi = call ? 1.0 : -1.0;
+		double eta = (type == BarrierType::DownIn || type == BarrierType::DownOut) ? 1.0 : -1.0;
+		V Sc = t.spotCarry, Xd = t.strikeDiscount;
+		V sPhi = phi, sRebate = rebate, sRebateDiscount = rebate * t.discount;
+
+		V A = sPhi * Sc * Ns(phi, t.Nx1) - sPhi * Xd * Ns(phi, t.Nx1s);
+		V B = sPhi * Sc * Ns(phi, t.Nx2) - sPhi * Xd * Ns(phi, t.Nx2s);
+		V C = sPhi * Sc * Pw(t.hs2mu1, Ns(eta, t.Ny1)) - sPhi * Xd * Pw(t.hs2mu, Ns(eta, t.Ny1s));
+		V D = sPhi * Sc * Pw(t.hs2mu1, Ns(eta, t.Ny2)) - sPhi * Xd * Pw(t.hs2mu, Ns(eta, t.Ny2s));
+		V E = 0.0, F = 0.0;
+		if (rebate != 0.0) {
+			E = sRebateDiscount * (Ns(eta, t.Nx2s) - Pw(t.hs2mu, Ns(eta, t.Ny2s)));
+			F = sRebate * (Pw(t.hsMuPlusLambda, Ns(eta, t.Nz)) + Pw(t.hsMuMinusLambda, Ns(eta, t.Nzs)));
+		}
+
+		bool above = t.strikeAboveBarrier;
+
+		// Once the barrier has been touched an "In" option is a vanilla (A) and an "Out" option pays its rebate
+		switch (type) {
+		case BarrierType::DownIn:
+			if (t.downHit) return A;
+			if (call) return above ? C + E : A - B + D + E;
+			return above ? B - C + D + E : A + E;
+		case BarrierType::UpIn:
+			if (t.upHit) return A;
+			if (call) return above ? A + E : B - C + D + E;
+			return above ? A - B + D + E : C + E;
+		case BarrierType::DownOut:
+			if (t.downHit) return sRebate;
+			if (call) return above ? A - C + F : B - D + F;
+			return above ? A - B + C - D + F : F;
+		default:
+			if (t.upHit) return sRebate;
+			if (call) return above ? F : A - B + C - D + F;
+			return above ? B - D + F : A - C + F;
+		}
+	}
+}
+
+double BarrierOptionPrice::Variant(const BarrierTerms& t, BarrierType type, bool call, double rebate)
+{
+	return Combine<double>(t, type, call, rebate);
+}
+
+BarrierGreeks BarrierOptionPrice::VariantGreeks(const BarrierTerms& t, BarrierType type, bool call, double rebate)
+{
+	Jet v = Combine<Jet>(Jets(t, t.spot), type, call, rebate);
+	return { v.v, v.d, v.dd };
+}
+
+BarrierPrices BarrierOptionPrice::Prices(const BarrierTerms& t, double rebate)
+{
+	BarrierPrices p;
+	p.downInCall = Variant(t, BarrierType::DownIn, true, rebate);
+	p.upInCall = Variant(t, BarrierType::UpIn, true, rebate);
+	p.downOutCall = Variant(t, BarrierType::DownOut, true, rebate);
+	p.upOutCall = Variant(t, BarrierType::UpOut, true, rebate);
+	p.downInPut = Variant(t, BarrierType::DownIn, false, rebate);
+	p.upInPut = Variant(t, BarrierType::UpIn, false, rebate);
+	p.downOutPut = Variant(t, BarrierType::DownOut, false, rebate);
+	p.upOutPut = Variant(t, BarrierType::UpOut, false, rebate);
+	return p;
+}
+
+double BarrierOptionPrice::Price(double U) const
+{
+	INSTRUMENT_CALL(Kernel::BarrierPrice);
+	INSTRUMENT_DOMAIN(Kernel::BarrierPrice, T <= 0.0 || sigma <= 0.0 || U <= 0.0 || H <= 0.0);
+
+	double price = Variant(Terms(U, K, H, T, r, sigma, b), barrier, optType == "C", rebate);
+
+	INSTRUMENT_RESULT(Kernel::BarrierPrice, price);
+	return price;
+}
+
+double BarrierOptionPrice::Delta(double U) const
+{
+	INSTRUMENT_CALL(Kernel::BarrierDelta);
+	INSTRUMENT_DOMAIN(Kernel::BarrierDelta, T <= 0.0 || sigma <= 0.0 || U <= 0.0 || H <= 0.0);
+
+	double delta = VariantGreeks(Terms(U, K, H, T, r, sigma, b), barrier, optType == "C", rebate).delta;
+
+	INSTRUMENT_RESULT(Kernel::BarrierDelta, delta);
+	return delta;
+}
+
+double BarrierOptionPrice::Gamma(double U) const
+{
+	INSTRUMENT_CALL(Kernel::BarrierGamma);
+	INSTRUMENT_DOMAIN(Kernel::BarrierGamma, T <= 0.0 || sigma <= 0.0 || U <= 0.0 || H <= 0.0);
+
+	double gamma = VariantGreeks(Terms(U, K, H, T, r, sigma, b), barrier, optType == "C", rebate).gamma;
+
+	INSTRUMENT_RESULT(Kernel::BarrierGamma, gamma);
+	return gamma;
+}
+
+// Delta and Gamma each repeat the terms with their spot derivatives
+double BarrierOptionPrice::CostHint() const
+{
+	return 6.5;
+}
+
+namespace {
+
+	// Value of a variant at T = 0 or sigma = 0, where the spot follows U e^(bt): the
+	// barrier is hit at t* = ln(H/U) / b if the forward crosses it before T. A hit
+	// "In" option is the payoff on the forward, a hit "Out" option pays its rebate at
+	// t*; otherwise "In" pays the rebate at expiry and "Out" the payoff.
+	double DegenerateVariant(double U, double K, double H, double T, double r, double b,
+		BarrierType type, bool call, double rebate)
+	{
+		double forward = U * exp(b * T);
+		bool down = type == BarrierType::DownIn || type == BarrierType::DownOut;
+		bool hit = down ? (U <= H || forward <= H) : (U >= H || forward >= H);
+		double hitTime = (U <= H && down) || (U >= H && !down) ? 0.0 : log(H / U) / b;
+
+		double phi = call ? 1.0 : -1.0;
+		double payoff = max(phi * (forward - K), 0.0) * exp(-r * T);
+		if (type == BarrierType::DownIn || type == BarrierType::UpIn)
+			return hit ? payoff : rebate * exp(-r * T);
+		return hit ? rebate * exp(-r * hitTime) : payoff;
+	}
+
+	// ClassifyRow with the barrier and rebate checked as well
+	RowDomain ClassifyBarrier(const BarrierOptionParams& p)
+	{
+		RowDomain d = ClassifyRow(p.S, p.K, p.T, p.r, p.sigma, p.b);
+		d.invalid = d.invalid || !(p.H > 0.0) || isnan(p.rebate);
+		return d;
+	}
+
+	// Terms on safe inputs: degenerate rows take T = 1 and sigma = 1
+	BarrierTerms SafeTerms(const BarrierOptionParams& p, const RowDomain& d)
+	{
+		double U = d.invalid ? 1.0 : p.S;
+		double K = d.invalid ? 1.0 : p.K;
+		double H = d.invalid ? 1.0 : p.H;
+		return BarrierOptionPrice::Terms(U, K, H, d.expired ? 1.0 : p.T, p.r, d.flat ? 1.0 : p.sigma, p.b);
+	}
+
+	double BlendVariant(const BarrierOptionParams& p, const RowDomain& d, const BarrierTerms& t,
+		BarrierType type, bool call)
+	{
+		double value = BarrierOptionPrice::Variant(t, type, call, p.rebate);
+		if (d.Degenerate() && !d.invalid)
+			value = DegenerateVariant(p.S, p.K, p.H, d.expired ? 0.0 : p.T, p.r, p.b, type, call, p.rebate);
+		return d.Valid(value);
+	}
+}
+
+vector<BarrierPrices> AllBarrierVariants(const vector<BarrierOptionParams>& book, BatchDomain* domain)
+{
+	INSTRUMENT_BATCH(Kernel::BarrierPrice, book.size());
+
+	if (domain)
+		domain->Reset(book.size());
+	vector<BarrierPrices> out(book.size());
+	ParallelRows(book.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const BarrierOptionParams& p = book[i];
+			RowDomain d = ClassifyBarrier(p);
+			BarrierTerms t = SafeTerms(p, d);
+			BarrierPrices& v = out[i];
+			v.downInCall = BlendVariant(p, d, t, BarrierType::DownIn, true);
+			v.upInCall = BlendVariant(p, d, t, BarrierType::UpIn, true);
+			v.downOutCall = BlendVariant(p, d, t, BarrierType::DownOut, true);
+			v.upOutCall = BlendVariant(p, d, t, BarrierType::UpOut, true);
+			v.downInPut = BlendVariant(p, d, t, BarrierType::DownIn, false);
+			v.upInPut = BlendVariant(p, d, t, BarrierType::UpIn, false);
+			v.downOutPut = BlendVariant(p, d, t, BarrierType::DownOut, false);
+			v.upOutPut = BlendVariant(p, d, t, BarrierType::UpOut, false);
+			if (domain)
+				domain->Set(i, d.Code());
+		}
+	});
+	if (domain)
+		domain->Finish();
+	return out;
+}
+
+vector<double> PriceBarrierBatch(const vector<BarrierOptionParams>& book, BatchDomain* domain)
+{
+	INSTRUMENT_BATCH(Kernel::BarrierPrice, book.size());
+
+	if (domain)
+		domain->Reset(book.size());
+	vector<double> out(book.size());
+	ParallelRows(book.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const BarrierOptionParams& p = book[i];
+			RowDomain d = ClassifyBarrier(p);
+			out[i] = BlendVariant(p, d, SafeTerms(p, d), p.barrier, p.optType == "C");
+			if (domain)
+				domain->Set(i, d.Code());
+		}
+	});
+	if (domain)
+		domain->Finish();
+	return out;
+}
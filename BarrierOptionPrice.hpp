@@ -0,0 +1,110 @@
+
+#ifndef BarrierOptionPrice_hpp
+#define BarrierOptionPrice_hpp
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include "Parameters.hpp"
+#include "OptionPrice.hpp"
+#include "Domain.hpp"
+
+// N(x) and N(-x), each from its own erfc: 1 - N(x) loses the relative accuracy of
+// N(-x) once N(x) is close to 1
+struct CdfPair {
+    double pos;     // N(x)
+    double neg;     // N(-x)
+};
+
+// Intermediates of the Reiner-Rubinstein formulas (Haug) for one contract. Every
+// variant is a combination of the terms A..F below, and those only need the ten
+// normal CDF pairs stored here (N(-x) covers the phi = -1 and eta = -1 cases) and
+// four powers of H/S.
+struct BarrierTerms {
+    double spot;
+    double sigmaSqrtT;
+    double spotCarry;       // S e^((b-r)T)
+    double strikeDiscount;  // X e^(-rT)
+    double discount;        // e^(-rT)
+
+    CdfPair Nx1, Nx1s;      // N(x1), N(x1 - sigma sqrt(T))
+    CdfPair Nx2, Nx2s;      // N(x2), N(x2 - sigma sqrt(T))
+    CdfPair Ny1, Ny1s;      // N(y1), N(y1 - sigma sqrt(T))
+    CdfPair Ny2, Ny2s;      // N(y2), N(y2 - sigma sqrt(T))
+    CdfPair Nz, Nzs;        // N(z),  N(z - 2 lambda sigma sqrt(T))
+
+    double hs2mu1;          // (H/S)^(2(mu+1))
+    double hs2mu;           // (H/S)^(2mu)
+    double hsMuPlusLambda;  // (H/S)^(mu+lambda)
+    double hsMuMinusLambda; // (H/S)^(mu-lambda)
+
+    // Kept for the spot derivatives: the exponents and the CDF arguments (the
+    // starred ones are these minus sigma sqrt(T), or 2 lambda sigma sqrt(T) for z)
+    double mu, lambda;
+    double x1, x2, y1, y2, z;
+
+    bool strikeAboveBarrier;    // X > H
+    bool downHit;               // S <= H: down barriers already touched
+    bool upHit;                 // S >= H: up barriers already touched
+};
+
+// Price of one variant with its first and second derivative in the spot
+struct BarrierGreeks {
+    double price;
+    double delta;
+    double gamma;
+};
+
+// All eight single-barrier variants of one contract
+struct BarrierPrices {
+    double downInCall;
+    double upInCall;
+    double downOutCall;
+    double upOutCall;
+    double downInPut;
+    double upInPut;
+    double downOutPut;
+    double upOutPut;
+};
+
+class BarrierOptionPrice : public OptionPrice
+{
+private:
+    void init();
+
+public:
+    double H;           // Barrier level
+    double rebate;      // Cash rebate
+    BarrierType barrier;
+
+    BarrierOptionPrice();
+    BarrierOptionPrice(const BarrierOptionParams& p);
+    virtual ~BarrierOptionPrice();
+
+    static BarrierTerms Terms(double U, double K, double H, double T, double r, double sigma, double b);
+    static double Variant(const BarrierTerms& t, BarrierType type, bool call, double rebate);
+    // The same combination of A..F over the terms and their closed-form spot
+    // derivatives: every term is a power of H/S times a normal CDF of a linear
+    // function of ln S, so delta and gamma need no bumped prices
+    static BarrierGreeks VariantGreeks(const BarrierTerms& t, BarrierType type, bool call, double rebate);
+    static BarrierPrices Prices(const BarrierTerms& t, double rebate);
+
+    double Price(double U) const override;
+
+    // Closed form, from VariantGreeks
+    double Delta(double U) const override;
+    double Gamma(double U) const override;
+    double CostHint() const override;
+};
+
+// Price of each contract of the book (its own variant). At T = 0 or sigma = 0 the
+// spot path is deterministic and a row gets its limit (payoff or rebate, depending
+// on whether the forward crosses H); NaN inputs, a non-positive S, K or H and a
+// negative T or sigma give NaN. The domain report, if any, records those rows.
+vector<double> PriceBarrierBatch(const vector<BarrierOptionParams>& book, BatchDomain* domain = nullptr);
+
+// All eight variants of each contract from one set of intermediates, with the same
+// limits and domain report as PriceBarrierBatch
+vector<BarrierPrices> AllBarrierVariants(const vector<BarrierOptionParams>& book, BatchDomain* domain = nullptr);
+
+#endif
@@ -0,0 +1,854 @@
+// Benchmark.cpp
+// Microbenchmarks (ns/option) and multi-thread throughput of the pricing kernels,
+// the OptionMatrix grids and their snapshots, the finite difference Greeks of
+// GreekCalculator, mixed books on the Scheduler, the adjoint book sensitivities, the
+// volatility surface calibration and the overhead of the kernel instrumentation.
+//
+// Usage: option_bench [--threads 1,2,4,8] [--size N] [--quick] [--filter text]
+//                     [--csv file] [--json file]
+//                     [--compare baseline.csv] [--tolerance 0.10] [--fail-on-regression]
+//
+// Every case splits its work into independent units; with t threads the units run
+// on a work-stealing Scheduler of t workers (see Scheduler.hpp). A case is repeated
+// until one run takes at least the minimum time and the best of several runs is
+// kept. ns/item is wall time per item, so at t threads it measures throughput
+// rather than latency.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "Adjoint.hpp"
+#include "AmericanOptionPrice.hpp"
+#include "Array.hpp"
+#include "BarrierOptionPrice.hpp"
+#include "CarryModels.hpp"
+#include "DigitalOptionPrice.hpp"
+#include "EuropeanOptionPrice.hpp"
+#include "Greeks.hpp"
+#include "GridSnapshot.hpp"
+#include "Instrumentation.hpp"
+#include "OptionMatrix.hpp"
+#include "Report.hpp"
+#include "Scheduler.hpp"
+#include "VolSurface.hpp"
+
+using namespace std;
+
+#ifndef __VERSION__
+#define __VERSION__ "unknown"
+#endif
+
+namespace {
+
+    struct BenchCase {
+        string name;
+        size_t units;           // independently schedulable pieces of work
+        size_t itemsPerUnit;    // options (or grid cells) priced per unit
+        function<double(size_t, size_t)> run;  // prices units [begin, end), returns a checksum
+        bool selfScheduled = false;             // run(0, units) spreads its work on the Scheduler
+        bool instrumented = false;              // runs with Instrumentation::Enable(true)
+    };
+
+    struct BenchResult {
+        string name;
+        unsigned threads;
+        double nsPerItem;
+        double itemsPerSec;
+        double speedup;         // throughput relative to one thread
+    };
+
+    struct Settings {
+        vector<unsigned> threads;
+        size_t size = 1 << 16;
+        double minSeconds = 0.05;
+        int repetitions = 5;
+        string filter;
+        string csvPath;
+        string jsonPath;
+        string comparePath;
+        double tolerance = 0.10;
+        bool failOnRegression = false;
+    };
+
+    volatile double g_sink;
+
+    const size_t kBlock = 1024;     // batch kernels price blocks of this many contracts
+
+    // Runs units [0, units) on a Scheduler of the given number of threads, `loops`
+    // times over. A self-scheduling case gets all its units in one call from this
+    // thread and uses the Scheduler itself.
+    double RunOnce(const BenchCase& c, unsigned threads, size_t loops)
+    {
+        Scheduler& pool = Scheduler::Shared();
+        pool.SetThreads(threads);
+
+        mutex sumMutex;
+        double total = 0.0;
+        Instrumentation::Enable(c.instrumented);
+        auto start = chrono::steady_clock::now();
+        for (size_t l = 0; l < loops; ++l) {
+            if (c.selfScheduled) {
+                total += c.run(0, c.units);
+                continue;
+            }
+            pool.ParallelFor(c.units, [&](size_t begin, size_t end) {
+                double sum = c.run(begin, end);
+                lock_guard<mutex> lock(sumMutex);
+                total += sum;
+            });
+        }
+        auto stop = chrono::steady_clock::now();
+        Instrumentation::Enable(false);
+
+        g_sink = total;
+        return chrono::duration<double>(stop - start).count();
+    }
+
+    BenchResult Measure(const BenchCase& c, unsigned threads, const Settings& s)
+    {
+        // Calibrate the loop count so that one run lasts at least minSeconds
+        size_t loops = 1;
+        double elapsed = RunOnce(c, threads, loops);
+        while (elapsed < s.minSeconds) {
+            loops *= 2;
+            elapsed = RunOnce(c, threads, loops);
+        }
+
+        double best = elapsed;
+        for (int rep = 1; rep < s.repetitions; ++rep)
+            best = min(best, RunOnce(c, threads, loops));
+
+        double items = double(c.units) * double(c.itemsPerUnit) * double(loops);
+        BenchResult r;
+        r.name = c.name;
+        r.threads = threads;
+        r.nsPerItem = best * 1e9 / items;
+        r.itemsPerSec = items / best;
+        r.speedup = 1.0;
+        return r;
+    }
+
+    // Random but reproducible contracts around the main.cpp parameters
+    vector<OptionParams> MakeBook(size_t n, CarryModel model, unsigned seed)
+    {
+        mt19937 gen(seed);
+        uniform_real_distribution<double> spot(80.0, 123.0), strike(90.0, 140.0), expiry(0.25, 1.5),
+            vol(0.1, 0.5), rate(0.0, 0.08);
+
+        vector<OptionParams> book(n);
+        for (size_t i = 0; i < n; ++i) {
+            OptionParams& p = book[i];
+            p = { spot(gen), strike(gen), expiry(gen), rate(gen), vol(gen), 0.0, (i % 2) ? "P" : "C", model };
+            if (model == CarryModel::BlackScholes)
+                p.b = p.r;
+            else if (model != CarryModel::Black76)
+                p.b = p.r - 0.02;
+        }
+        return book;
+    }
+
+    vector<vector<OptionParams>> Blocks(const vector<OptionParams>& book)
+    {
+        vector<vector<OptionParams>> blocks;
+        for (size_t i = 0; i < book.size(); i += kBlock)
+            blocks.emplace_back(book.begin() + i, book.begin() + min(book.size(), i + kBlock));
+        return blocks;
+    }
+
+    // 5 expiries x 19 strikes, out-of-the-money calls and puts priced on an SSVI
+    // surface (rho -0.5, eta 1.2, gamma 0.4, theta(T) = 0.04 T (1 + 0.2 T))
+    vector<OptionQuote> SurfaceQuotes(double S)
+    {
+        const double r = 0.05, b = 0.02, rho = -0.5, eta = 1.2, gamma = 0.4;
+        vector<OptionQuote> quotes;
+        for (double T : { 0.1, 0.25, 0.5, 1.0, 2.0 }) {
+            double theta = 0.04 * T * (1.0 + 0.2 * T);
+            double phi = eta * pow(theta, -gamma) * pow(1.0 + theta, gamma - 1.0);
+            for (double K = 60.0; K <= 150.0; K += 5.0) {
+                double k = log(K / S) - b * T;
+                double u = phi * k + rho;
+                double w = 0.5 * theta * (1.0 + rho * phi * k + sqrt(u * u + 1.0 - rho * rho));
+                string type = K >= S ? "C" : "P";
+                EuropeanOptionPrice option(OptionParams{ S, K, T, r, sqrt(w / T), b, type });
+                quotes.push_back({ K, T, option.Price(S), type });
+            }
+        }
+        return quotes;
+    }
+
+    // True if the --filter text selects any of the named cases. Groups with a costly
+    // setup (files, calibrations, large books and grids) are only built when selected.
+    bool Selected(const string& filter, initializer_list<const char*> names)
+    {
+        if (filter.empty())
+            return true;
+        for (const char* name : names)
+            if (string(name).find(filter) != string::npos)
+                return true;
+        return false;
+    }
+
+    // A file in the temp directory, removed with the last case that uses it
+    struct TempFile {
+        string path;
+
+        explicit TempFile(const string& name) : path((filesystem::temp_directory_path() / name).string()) {}
+        ~TempFile()
+        {
+            error_code ec;
+            filesystem::remove(path, ec);
+        }
+    };
+
+    vector<BenchCase> MakeCases(size_t n, const string& filter)
+    {
+        vector<BenchCase> cases;
+        n = max(kBlock, n / kBlock * kBlock);
+
+        // Scalar European kernels through the OptionPrice interface
+        auto book = make_shared<vector<OptionParams>>(MakeBook(n, CarryModel::Generic, 1));
+        auto europeans = make_shared<vector<unique_ptr<OptionPrice>>>();
+        for (const OptionParams& p : *book)
+            europeans->push_back(make_unique<EuropeanOptionPrice>(p));
+
+        auto scalar = [&cases, n](const string& name, shared_ptr<vector<unique_ptr<OptionPrice>>> options,
+            shared_ptr<vector<OptionParams>> params, int what) {
+            cases.push_back({ name, n, 1, [options, params, what](size_t begin, size_t end) {
+                double sum = 0.0;
+                for (size_t i = begin; i < end; ++i) {
+                    const OptionPrice& o = *(*options)[i];
+                    double S = (*params)[i].S;
+                    sum += (what == 0) ? o.Price(S) : (what == 1) ? o.Delta(S) : o.Gamma(S);
+                }
+                return sum;
+            } });
+        };
+        scalar("european.price.scalar", europeans, book, 0);
+        scalar("european.delta.scalar", europeans, book, 1);
+        scalar("european.gamma.scalar", europeans, book, 2);
+
+        // Instrumentation overhead: the price kernel with recording off and on, and the
+        // hooks of one idle (compiled-in but disabled) kernel call on their own: the
+        // timer, the domain check and the result check, as in EuropeanOptionPrice::Price
+        scalar("instrumentation.off", europeans, book, 0);
+        scalar("instrumentation.on", europeans, book, 0);
+        cases.back().instrumented = true;
+        cases.push_back({ "instrumentation.idle_hook", n, 1, [](size_t begin, size_t end) {
+            size_t sum = 0;
+            for (size_t i = begin; i < end; ++i) {
+                INSTRUMENT_CALL(Kernel::EuropeanPrice);
+                INSTRUMENT_DOMAIN(Kernel::EuropeanPrice, i == 0);
+                sum += i;
+                INSTRUMENT_RESULT(Kernel::EuropeanPrice, double(sum));
+            }
+            return double(sum);
+        } });
+
+        // European batch kernels, one run per cost-of-carry model and the generic path
+        const CarryModel models[] = { CarryModel::Generic, CarryModel::BlackScholes, CarryModel::Merton,
+            CarryModel::Black76, CarryModel::GarmanKohlhagen };
+        const char* modelNames[] = { "generic", "blackscholes", "merton", "black76", "garmankohlhagen" };
+        for (int m = 0; m < 5; ++m) {
+            auto blocks = make_shared<vector<vector<OptionParams>>>(Blocks(MakeBook(n, models[m], 2 + m)));
+            cases.push_back({ string("european.batch.") + modelNames[m], blocks->size(), kBlock,
+                [blocks](size_t begin, size_t end) {
+                    double sum = 0.0;
+                    for (size_t i = begin; i < end; ++i)
+                        sum += PriceEuropeanBatch((*blocks)[i]).back().price;
+                    return sum;
+                } });
+            if (m != 0) {
+                cases.push_back({ string("european.batch.") + modelNames[m] + ".as_generic", blocks->size(), kBlock,
+                    [blocks](size_t begin, size_t end) {
+                        double sum = 0.0;
+                        for (size_t i = begin; i < end; ++i)
+                            sum += PriceEuropeanBatchGeneric((*blocks)[i]).back().price;
+                        return sum;
+                    } });
+            }
+        }
+
+        // Perpetual American kernels
+        auto americans = make_shared<vector<unique_ptr<OptionPrice>>>();
+        for (const OptionParams& p : *book) {
+            PerpetualOptionParams pp(p.S, p.K, 0.0, p.sigma, 0.1, 0.02, p.optType);
+            americans->push_back(make_unique<AmericanOptionPrice>(pp));
+        }
+        scalar("american.price.scalar", americans, book, 0);
+        scalar("american.delta.scalar", americans, book, 1);
+        scalar("american.gamma.scalar", americans, book, 2);
+
+        auto spots = make_shared<vector<double>>();
+        auto strikes = make_shared<vector<double>>();
+        for (const OptionParams& p : *book) {
+            spots->push_back(p.S);
+            strikes->push_back(p.K);
+        }
+        cases.push_back({ "american.greeks.batch", n / kBlock, kBlock, [spots, strikes](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i) {
+                vector<double> s(spots->begin() + i * kBlock, spots->begin() + (i + 1) * kBlock);
+                vector<double> k(strikes->begin() + i * kBlock, strikes->begin() + (i + 1) * kBlock);
+                sum += AmericanOptionPrice::GreeksBatch(s, k, 0.1, 0.2, 0.02, "C").back().delta;
+            }
+            return sum;
+        } });
+
+        // Spot ladders: one contract over a uniform 1024-spot mesh per unit, against the
+        // scalar kernel at every spot
+        auto ladderSpots = make_shared<vector<double>>(GenerateMeshArray(50.0, 50.0 + 0.1 * (kBlock - 1), 0.1));
+        cases.push_back({ "european.ladder", n / kBlock, kBlock, [book, ladderSpots](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i)
+                sum += PriceEuropeanLadder((*book)[i], *ladderSpots).gamma.back();
+            return sum;
+        } });
+        cases.push_back({ "european.ladder.scalar", n / kBlock, kBlock, [europeans, ladderSpots](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i) {
+                const OptionPrice& option = *(*europeans)[i];
+                for (double S : *ladderSpots)
+                    sum += option.Price(S) + option.Delta(S) + option.Gamma(S);
+            }
+            return sum;
+        } });
+
+        // Theta ladders: the block revalued today and on each of the next 30 days, against
+        // one EuropeanOptionPrice per contract and date
+        auto rollOffsets = make_shared<vector<double>>();
+        for (int day = 0; day <= 30; ++day)
+            rollOffsets->push_back(day / 365.0);
+        auto blocks = make_shared<vector<vector<OptionParams>>>(Blocks(*book));
+        cases.push_back({ "european.roll", blocks->size(), kBlock * rollOffsets->size(), [blocks, rollOffsets](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i)
+                sum += PriceEuropeanTimeRoll((*blocks)[i], *rollOffsets).values.back().price;
+            return sum;
+        } });
+        cases.push_back({ "european.roll.scalar", blocks->size(), kBlock * rollOffsets->size(), [blocks, rollOffsets](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i)
+                for (const OptionParams& p : (*blocks)[i])
+                    for (double offset : *rollOffsets) {
+                        OptionParams q = p;
+                        q.T -= offset;
+                        EuropeanOptionPrice option(q);
+                        sum += option.Price(p.S) + option.Delta(p.S) + option.Gamma(p.S);
+                    }
+            return sum;
+        } });
+
+        // Digital and barrier batches
+        auto digitals = make_shared<vector<vector<DigitalOptionParams>>>();
+        auto barriers = make_shared<vector<vector<BarrierOptionParams>>>();
+        for (size_t i = 0; i < book->size(); i += kBlock) {
+            vector<DigitalOptionParams> d;
+            vector<BarrierOptionParams> bb;
+            for (size_t j = i; j < i + kBlock; ++j) {
+                const OptionParams& p = (*book)[j];
+                d.push_back({ p.S, p.K, p.T, p.r, p.sigma, p.b, p.optType, DigitalPayoff::CashOrNothing, 1.0 });
+                bb.push_back({ p.S, p.K, p.T, p.r, p.sigma, p.b, 0.9 * p.S, 1.0, p.optType, BarrierType::DownOut });
+            }
+            digitals->push_back(d);
+            barriers->push_back(bb);
+        }
+        cases.push_back({ "digital.batch", digitals->size(), kBlock, [digitals](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i)
+                sum += PriceDigitalBatch((*digitals)[i]).back();
+            return sum;
+        } });
+        cases.push_back({ "barrier.batch", barriers->size(), kBlock, [barriers](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i)
+                sum += PriceBarrierBatch((*barriers)[i]).back();
+            return sum;
+        } });
+        cases.push_back({ "barrier.all_variants", barriers->size(), kBlock, [barriers](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i)
+                sum += AllBarrierVariants((*barriers)[i]).back().upOutPut;
+            return sum;
+        } });
+
+        // OptionMatrix grids: the main.cpp axes refined to 64 expiries x 32 strikes x 32 vols,
+        // split across threads by expiry (by strike for the perpetual grid)
+        auto gridStrikes = make_shared<vector<double>>();
+        auto gridVols = make_shared<vector<double>>();
+        auto gridExpiries = make_shared<vector<double>>();
+        for (int i = 0; i < 32; ++i) {
+            gridStrikes->push_back(90.0 + 50.0 * i / 31.0);
+            gridVols->push_back(0.1 + 0.4 * i / 31.0);
+        }
+        for (int i = 0; i < 64; ++i)
+            gridExpiries->push_back(0.25 + 1.25 * i / 63.0);
+
+        const MatrixGreek greeks[] = { MatrixGreek::Price, MatrixGreek::Delta, MatrixGreek::Gamma };
+        const char* greekNames[] = { "grid.price", "grid.delta", "grid.gamma" };
+        for (int g = 0; g < 3; ++g) {
+            MatrixGreek greek = greeks[g];
+            cases.push_back({ greekNames[g], gridExpiries->size(), gridStrikes->size() * gridVols->size(),
+                [gridStrikes, gridVols, gridExpiries, greek](size_t begin, size_t end) {
+                    vector<double> expiries(gridExpiries->begin() + begin, gridExpiries->begin() + end);
+                    vector<double> values = ComputeOptionMatrix(100.0, 0.05, *gridStrikes, *gridVols, expiries, greek);
+                    return values.empty() ? 0.0 : values.back();
+                } });
+        }
+        cases.push_back({ "grid.perpetual", gridStrikes->size(), gridVols->size(),
+            [gridStrikes, gridVols](size_t begin, size_t end) {
+                vector<double> strikes(gridStrikes->begin() + begin, gridStrikes->begin() + end);
+                vector<double> values = ComputePerpetualMatrix(110.0, 0.1, strikes, *gridVols, 0.02, "C");
+                return values.empty() ? 0.0 : values.back();
+            } });
+
+        // The three European grids per unit through GridCache: computed, attached from
+        // a snapshot of the same inputs, and attached after a change of r (the grids
+        // are rebuilt from the cached log(S / K) and sigma sqrt(T))
+        if (Selected(filter, { "grid.snapshot.compute", "grid.snapshot.attach", "grid.snapshot.rate_change" })) {
+            auto snapshot = make_shared<TempFile>("option_bench.grids");
+            {
+                GridCache cache;
+                for (MatrixGreek greek : greeks)
+                    cache.OptionMatrix(100.0, 0.05, *gridStrikes, *gridVols, *gridExpiries, greek);
+                cache.Save(snapshot->path);
+            }
+            size_t gridCells = 3 * gridExpiries->size() * gridStrikes->size() * gridVols->size();
+            auto snapshotCase = [&cases, &greeks, gridStrikes, gridVols, gridExpiries, gridCells, snapshot](
+                const string& name, bool attach, double r) {
+                vector<MatrixGreek> all(greeks, greeks + 3);
+                cases.push_back({ name, 8, gridCells,
+                    [gridStrikes, gridVols, gridExpiries, snapshot, all, attach, r](size_t begin, size_t end) {
+                        double sum = 0.0;
+                        for (size_t i = begin; i < end; ++i) {
+                            GridCache cache;
+                            if (attach)
+                                cache.Attach(snapshot->path);
+                            for (MatrixGreek greek : all)
+                                sum += cache.OptionMatrix(100.0, r, *gridStrikes, *gridVols, *gridExpiries, greek).data[0];
+                        }
+                        return sum;
+                    } });
+            };
+            snapshotCase("grid.snapshot.compute", false, 0.05);
+            snapshotCase("grid.snapshot.attach", true, 0.05);
+            snapshotCase("grid.snapshot.rate_change", true, 0.06);
+        }
+
+        // GreekCalculator divided differences against the analytic Greeks (same contracts)
+        auto fd = [&cases, n, europeans, book](const string& name, int what) {
+            cases.push_back({ name, n, 1, [europeans, book, what](size_t begin, size_t end) {
+                double sum = 0.0;
+                for (size_t i = begin; i < end; ++i) {
+                    GreekCalculator calc(*(*europeans)[i]);
+                    double S = (*book)[i].S;
+                    sum += (what == 0) ? calc.DeltaFD(S, 0.01) : calc.GammaFD(S, 0.01);
+                }
+                return sum;
+            } });
+        };
+        fd("greeks.fd.delta", 0);
+        fd("greeks.fd.gamma", 1);
+
+        // One contract's divided-difference delta over a mesh of n spots, cut into
+        // kMeshGrain ranges by GreekCalculator itself
+        auto meshSpots = make_shared<vector<double>>(n);
+        for (size_t i = 0; i < n; ++i)
+            (*meshSpots)[i] = 50.0 + 100.0 * double(i) / double(n);
+        BenchCase mesh = { "greeks.fd.mesh", n, 1, [europeans, meshSpots](size_t, size_t) {
+            return GreekCalculator(*(*europeans)[0]).DeltaFD(*meshSpots, 0.01).back();
+        } };
+        mesh.selfScheduled = true;
+        cases.push_back(mesh);
+
+        // A mixed book as it comes out of a product-sorted position file: Europeans,
+        // digitals and perpetuals first, the barriers (about 6x the cost) together at
+        // the end. PriceBook on the Scheduler against static contiguous chunks on as
+        // many threads; both price, delta and gamma of every contract.
+        if (Selected(filter, { "book.mixed", "book.mixed.static" })) {
+            auto mixed = make_shared<vector<unique_ptr<OptionPrice>>>();
+            for (size_t i = 0; i < n; ++i) {
+                const OptionParams& p = (*book)[i];
+                size_t kind = i * 8 / n;
+                if (kind < 4)
+                    mixed->push_back(make_unique<EuropeanOptionPrice>(p));
+                else if (kind == 4)
+                    mixed->push_back(make_unique<DigitalOptionPrice>(
+                        DigitalOptionParams{ p.S, p.K, p.T, p.r, p.sigma, p.b, p.optType, DigitalPayoff::CashOrNothing, 1.0 }));
+                else if (kind == 5)
+                    mixed->push_back(make_unique<AmericanOptionPrice>(
+                        PerpetualOptionParams(p.S, p.K, 0.0, p.sigma, p.r, p.b, p.optType)));
+                else
+                    mixed->push_back(make_unique<BarrierOptionPrice>(
+                        BarrierOptionParams{ p.S, p.K, p.T, p.r, p.sigma, p.b, 0.9 * p.S, 1.0, p.optType, BarrierType::DownOut }));
+            }
+            BenchCase mixedBook = { "book.mixed", n, 1, [mixed](size_t, size_t) {
+                return PriceBook(*mixed).back().price;
+            } };
+            mixedBook.selfScheduled = true;
+            cases.push_back(mixedBook);
+
+            BenchCase mixedStatic = { "book.mixed.static", n, 1, [mixed](size_t, size_t) {
+                size_t threads = Scheduler::Shared().Threads();
+                vector<double> sums(threads, 0.0);
+                auto work = [&](size_t t) {
+                    for (size_t i = mixed->size() * t / threads; i < mixed->size() * (t + 1) / threads; ++i) {
+                        const OptionPrice& o = *(*mixed)[i];
+                        sums[t] += o.Price(o.S) + o.Delta(o.S) + o.Gamma(o.S);
+                    }
+                };
+                vector<thread> pool;
+                for (size_t t = 1; t < threads; ++t)
+                    pool.emplace_back(work, t);
+                work(0);
+                for (thread& th : pool)
+                    th.join();
+                return sums[0];
+            } };
+            mixedStatic.selfScheduled = true;
+            cases.push_back(mixedStatic);
+        }
+
+        // Formatting the price grid (one expiry per unit): the report writer in each
+        // format against the per-cell iostream formatting it replaced
+        if (Selected(filter, { "report.text", "report.csv", "report.json", "report.iostream" })) {
+            auto gridValues = make_shared<vector<double>>(
+                ComputeOptionMatrix(100.0, 0.05, *gridStrikes, *gridVols, *gridExpiries, MatrixGreek::Price));
+            auto gridTables = make_shared<vector<ReportTable>>(
+                OptionMatrixTables(*gridValues, *gridStrikes, *gridVols, *gridExpiries, MatrixGreek::Price, 4));
+            size_t cellsPerExpiry = gridStrikes->size() * gridVols->size();
+
+            const ReportFormat formats[] = { ReportFormat::Text, ReportFormat::Csv, ReportFormat::Json };
+            const char* formatNames[] = { "report.text", "report.csv", "report.json" };
+            for (int f = 0; f < 3; ++f) {
+                ReportFormat format = formats[f];
+                cases.push_back({ formatNames[f], gridExpiries->size(), cellsPerExpiry,
+                    [gridTables, format](size_t begin, size_t end) {
+                        vector<ReportTable> tables(gridTables->begin() + begin, gridTables->begin() + end);
+                        ReportBuffer out;
+                        WriteTables(out, tables, format);
+                        return double(out.size());
+                    } });
+            }
+            cases.push_back({ "report.iostream", gridExpiries->size(), cellsPerExpiry,
+                [gridValues, gridStrikes, gridVols, gridExpiries, cellsPerExpiry](size_t begin, size_t end) {
+                    ostringstream out;
+                    out << fixed << setprecision(4);
+                    const double* v = gridValues->data() + begin * cellsPerExpiry;
+                    for (size_t e = begin; e < end; ++e) {
+                        out << "\nExpiry Time: " << (*gridExpiries)[e] << "\n" << setw(10) << "K\\Vol";
+                        for (double vol : *gridVols)
+                            out << setw(10) << vol;
+                        out << endl;
+                        for (double K : *gridStrikes) {
+                            out << setw(10) << K;
+                            for (size_t j = 0; j < gridVols->size(); ++j)
+                                out << setw(10) << *v++;
+                            out << endl;
+                        }
+                    }
+                    return double(out.str().size());
+                } });
+        }
+
+        // Book sensitivities to 8 rates, 8 carries and 8 x 8 vols (80 inputs): one
+        // adjoint run against one plain pricing pass and central bumps of every input.
+        // A unit is a book of kBlock positions, one in five a perpetual put.
+        if (Selected(filter, { "adjoint.value", "adjoint.sensitivities", "adjoint.bump" })) {
+            auto market = make_shared<AdjointMarket>();
+            for (int e = 0; e < 8; ++e) {
+                market->expiries.push_back(0.25 * (e + 1));
+                market->rates.push_back(0.02 + 0.002 * e);
+                market->carries.push_back(0.01 + 0.001 * e);
+                market->strikes.push_back(80.0 + 5.0 * e);
+                for (int k = 0; k < 8; ++k)
+                    market->vols.push_back(0.15 + 0.01 * e + 0.005 * k);
+            }
+            auto positions = make_shared<vector<vector<Position>>>();
+            for (size_t i = 0; i < book->size(); i += kBlock) {
+                positions->emplace_back();
+                for (size_t j = i; j < i + kBlock; ++j) {
+                    Position pos = { (*book)[j], (j % 2) ? 1.0 : -0.5, j % 5 == 0 };
+                    if (pos.perpetual)
+                        pos.contract.optType = "P";
+                    positions->back().push_back(pos);
+                }
+            }
+            size_t adjointUnits = min<size_t>(positions->size(), 8);
+            cases.push_back({ "adjoint.value", adjointUnits, kBlock, [positions, market](size_t begin, size_t end) {
+                double sum = 0.0;
+                for (size_t i = begin; i < end; ++i)
+                    sum += PortfolioValue((*positions)[i], *market);
+                return sum;
+            } });
+            cases.push_back({ "adjoint.sensitivities", adjointUnits, kBlock, [positions, market](size_t begin, size_t end) {
+                AdjointPortfolio portfolio;
+                double sum = 0.0;
+                for (size_t i = begin; i < end; ++i)
+                    sum += portfolio.Sensitivities((*positions)[i], *market).vols.back();
+                return sum;
+            } });
+            cases.push_back({ "adjoint.bump", adjointUnits, kBlock, [positions, market](size_t begin, size_t end) {
+                AdjointMarket m = *market;
+                double sum = 0.0;
+                for (size_t i = begin; i < end; ++i) {
+                    const vector<Position>& book = (*positions)[i];
+                    for (vector<double>* inputs : { &m.rates, &m.carries, &m.vols }) {
+                        for (double& x : *inputs) {
+                            double x0 = x;
+                            x = x0 + 1e-6;
+                            double up = PortfolioValue(book, m);
+                            x = x0 - 1e-6;
+                            sum += (up - PortfolioValue(book, m)) / 2e-6;
+                            x = x0;
+                        }
+                    }
+                }
+                return sum;
+            } });
+        }
+
+        // Surface calibration on quotes generated from a known SSVI surface (one
+        // surface per unit), warm refits after a spot move, and sigma(K, T) lookups
+        if (Selected(filter, { "volsurface.calibrate", "volsurface.refit", "volsurface.sigma", "volsurface.sigma_exact" })) {
+            auto quotes = make_shared<vector<OptionQuote>>(SurfaceQuotes(100.0));
+            auto moved = make_shared<vector<OptionQuote>>(SurfaceQuotes(100.5));
+            auto surface = make_shared<VolSurface>(100.0, 0.05, 0.02);
+            surface->Calibrate(*quotes);
+
+            cases.push_back({ "volsurface.calibrate", 8, 1, [quotes](size_t begin, size_t end) {
+                double sum = 0.0;
+                for (size_t i = begin; i < end; ++i) {
+                    VolSurface s(100.0, 0.05, 0.02);
+                    sum += s.Calibrate(*quotes).ssviRmse;
+                }
+                return sum;
+            } });
+            cases.push_back({ "volsurface.refit", 8, 1, [surface, moved](size_t begin, size_t end) {
+                double sum = 0.0;
+                for (size_t i = begin; i < end; ++i) {
+                    VolSurface s = *surface;
+                    s.SetSpot(100.5);
+                    sum += s.Refit(*moved).ssviRmse;
+                }
+                return sum;
+            } });
+            auto lookup = [&cases, n, surface, book](const string& name, bool exact) {
+                cases.push_back({ name, n, 1, [surface, book, exact](size_t begin, size_t end) {
+                    double sum = 0.0;
+                    for (size_t i = begin; i < end; ++i) {
+                        const OptionParams& p = (*book)[i];
+                        sum += exact ? surface->SigmaExact(p.K, p.T) : surface->Sigma(p.K, p.T);
+                    }
+                    return sum;
+                } });
+            };
+            lookup("volsurface.sigma", false);
+            lookup("volsurface.sigma_exact", true);
+        }
+
+        return cases;
+    }
+
+    vector<unsigned> DefaultThreads()
+    {
+        unsigned hw = max(1u, thread::hardware_concurrency());
+        vector<unsigned> threads;
+        for (unsigned t = 1; t < hw; t *= 2)
+            threads.push_back(t);
+        threads.push_back(hw);
+        return threads;
+    }
+
+    vector<unsigned> ParseThreads(const string& list)
+    {
+        vector<unsigned> threads;
+        stringstream in(list);
+        string item;
+        while (getline(in, item, ','))
+            if (!item.empty())
+                threads.push_back(max(1u, static_cast<unsigned>(stoul(item))));
+        return threads;
+    }
+
+    void WriteCsv(const string& path, const vector<BenchResult>& results)
+    {
+        ofstream out(path);
+        out << "name,threads,ns_per_item,items_per_sec,speedup\n";
+        out << setprecision(9);
+        for (const BenchResult& r : results)
+            out << r.name << "," << r.threads << "," << r.nsPerItem << "," << r.itemsPerSec << "," << r.speedup << "\n";
+    }
+
+    void WriteJson(const string& path, const vector<BenchResult>& results, const Settings& s)
+    {
+        ofstream out(path);
+        out << setprecision(9);
+        out << "{\n  \"hardware_threads\": " << thread::hardware_concurrency()
+            << ",\n  \"size\": " << s.size
+            << ",\n  \"compiler\": \"" << __VERSION__ << "\""
+            << ",\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchResult& r = results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"threads\": " << r.threads
+                << ", \"ns_per_item\": " << r.nsPerItem << ", \"items_per_sec\": " << r.itemsPerSec
+                << ", \"speedup\": " << r.speedup << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+    // Idle overhead is the cost of the disabled hook relative to the price kernel it
+    // wraps; enabled overhead compares the kernel with recording on and off
+    void ReportInstrumentationOverhead(const vector<BenchResult>& results)
+    {
+        map<pair<string, unsigned>, double> ns;
+        for (const BenchResult& r : results)
+            ns[{ r.name, r.threads }] = r.nsPerItem;
+
+        for (const BenchResult& r : results) {
+            if (r.name != "instrumentation.off")
+                continue;
+            auto hook = ns.find({ "instrumentation.idle_hook", r.threads });
+            auto on = ns.find({ "instrumentation.on", r.threads });
+            if (hook == ns.end() || on == ns.end())
+                continue;
+            cout << "Instrumentation overhead at " << r.threads << " thread(s): idle "
+                << fixed << setprecision(2) << 100.0 * hook->second / r.nsPerItem << "% ("
+                << hook->second << " ns/call), enabled " << 100.0 * (on->second / r.nsPerItem - 1.0) << "%\n";
+        }
+    }
+
+    // Each specialised cost-of-carry kernel against the generic kernel on the same book
+    void ReportCarryModelSpeedups(const vector<BenchResult>& results)
+    {
+        map<pair<string, unsigned>, double> ns;
+        for (const BenchResult& r : results)
+            ns[{ r.name, r.threads }] = r.nsPerItem;
+
+        for (const BenchResult& r : results) {
+            auto generic = ns.find({ r.name + ".as_generic", r.threads });
+            if (generic == ns.end())
+                continue;
+            cout << "Carry model " << r.name << " at " << r.threads << " thread(s): "
+                << fixed << setprecision(2) << generic->second / r.nsPerItem << "x the generic kernel\n";
+        }
+    }
+
+    // Compares against a CSV written by an earlier run; returns the number of regressions
+    int Compare(const string& path, const vector<BenchResult>& results, double tolerance)
+    {
+        ifstream in(path);
+        if (!in) {
+            cerr << "Cannot read baseline " << path << "\n";
+            return 0;
+        }
+
+        map<pair<string, unsigned>, double> baseline;
+        string line;
+        getline(in, line);  // header
+        while (getline(in, line)) {
+            stringstream row(line);
+            string name, threads, ns;
+            getline(row, name, ',');
+            getline(row, threads, ',');
+            getline(row, ns, ',');
+            if (!name.empty() && !threads.empty() && !ns.empty())
+                baseline[{ name, static_cast<unsigned>(stoul(threads)) }] = stod(ns);
+        }
+
+        int regressions = 0;
+        cout << "\nComparison with " << path << " (ratio = new / baseline ns per item)\n";
+        for (const BenchResult& r : results) {
+            auto it = baseline.find({ r.name, r.threads });
+            if (it == baseline.end())
+                continue;
+            double ratio = r.nsPerItem / it->second;
+            bool regressed = ratio > 1.0 + tolerance;
+            regressions += regressed ? 1 : 0;
+            cout << left << setw(40) << r.name << right << setw(4) << r.threads
+                << fixed << setprecision(3) << setw(10) << ratio << (regressed ? "  REGRESSION" : "") << "\n";
+        }
+        return regressions;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Settings s;
+    s.threads = DefaultThreads();
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto next = [&]() { return (i + 1 < argc) ? string(argv[++i]) : string(); };
+        if (arg == "--threads") s.threads = ParseThreads(next());
+        else if (arg == "--size") s.size = stoul(next());
+        else if (arg == "--quick") { s.size = 1 << 13; s.minSeconds = 0.01; s.repetitions = 3; }
+        else if (arg == "--filter") s.filter = next();
+        else if (arg == "--csv") s.csvPath = next();
+        else if (arg == "--json") s.jsonPath = next();
+        else if (arg == "--compare") s.comparePath = next();
+        else if (arg == "--tolerance") s.tolerance = stod(next());
+        else if (arg == "--fail-on-regression") s.failOnRegression = true;
+        else {
+            cerr << "Usage: option_bench [--threads 1,2,4] [--size N] [--quick] [--filter text]\n"
+                 << "                    [--csv file] [--json file] [--compare baseline.csv]\n"
+                 << "                    [--tolerance 0.10] [--fail-on-regression]\n";
+            return 1;
+        }
+    }
+
+    vector<BenchCase> cases = MakeCases(s.size, s.filter);
+    vector<BenchResult> results;
+
+    cout << left << setw(40) << "case" << right << setw(8) << "threads" << setw(12) << "ns/item"
+        << setw(16) << "items/s" << setw(10) << "speedup" << "\n";
+
+    for (const BenchCase& c : cases) {
+        if (!s.filter.empty() && c.name.find(s.filter) == string::npos)
+            continue;
+
+        double single = 0.0;
+        for (unsigned t : s.threads) {
+            BenchResult r = Measure(c, t, s);
+            if (t == s.threads.front())
+                single = r.itemsPerSec / t;
+            r.speedup = r.itemsPerSec / single;
+            results.push_back(r);
+
+            cout << left << setw(40) << r.name << right << setw(8) << r.threads
+                << fixed << setprecision(2) << setw(12) << r.nsPerItem
+                << setprecision(0) << setw(16) << r.itemsPerSec
+                << setprecision(2) << setw(10) << r.speedup << "\n";
+        }
+    }
+
+    if (!s.csvPath.empty())
+        WriteCsv(s.csvPath, results);
+    if (!s.jsonPath.empty())
+        WriteJson(s.jsonPath, results, s);
+
+    ReportCarryModelSpeedups(results);
+    ReportInstrumentationOverhead(results);
+
+    int regressions = 0;
+    if (!s.comparePath.empty())
+        regressions = Compare(s.comparePath, results, s.tolerance);
+
+    return (s.failOnRegression && regressions > 0) ? 2 : 0;
+}
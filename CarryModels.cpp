@@ -0,0 +1,291 @@
+
+#include "CarryModels.hpp"
+#include "Instrumentation.hpp"
+#include "Scheduler.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+    const double kInvSqrt2 = 0.70710678118654752440;
+    const double kInvSqrt2Pi = 0.39894228040143267794;
+
+    // N(x) through erfc so that the put side keeps its accuracy in the tails
+    inline double CumNormal(double x)
+    {
+        return 0.5 * erfc(-x * kInvSqrt2);
+    }
+
+    // Rows outside the formula's domain (see Domain.hpp) are evaluated on safe inputs
+    // and their limits are blended in with selects, so a degenerate contract costs
+    // the same as any other and needs no separate path. Valid rows are unchanged.
+    template <CarryModel M>
+    inline EuropeanResult EuropeanKernel(const OptionParams& p, uint8_t& code)
+    {
+        RowDomain d = ClassifyRow(p.S, p.K, p.T, p.r, p.sigma, p.b);
+        double U = d.invalid ? 1.0 : p.S;
+        double K = d.invalid ? 1.0 : p.K;
+        CarryTerms c = MakeCarryTerms<M>(d.expired ? 1.0 : p.T, p.r, d.flat ? 1.0 : p.sigma, p.b);
+
+        double d1 = (log(U / K) + c.drift) / c.sigmaSqrtT;
+        double d2 = d1 - c.sigmaSqrtT;
+        double w = p.optType == "C" ? 1.0 : -1.0;
+
+        // For a put N(-d1) and N(-d2) enter the formula, so both cases need two CDFs
+        double Nd1 = CumNormal(w * d1);
+        double Nd2 = CumNormal(w * d2);
+
+        // At expiry (spot against strike) and at zero volatility (forward against
+        // strike) both N terms become the exercise indicator
+        double carry = d.expired ? 1.0 : c.carry;
+        double discount = d.expired ? 1.0 : c.discount;
+        double exercise = (w * (U * carry - K * discount) > 0.0) ? 1.0 : 0.0;
+        Nd1 = d.Limit(Nd1, exercise);
+        Nd2 = d.Limit(Nd2, exercise);
+
+        EuropeanResult res;
+        res.price = d.Valid(w * (U * carry * Nd1 - K * discount * Nd2));
+        res.delta = d.Valid(w * carry * Nd1);
+        res.gamma = d.Valid(d.Limit(c.carry * kInvSqrt2Pi * exp(-0.5 * d1 * d1) / (U * c.sigmaSqrtT), 0.0));
+
+        code = d.Code();
+        return res;
+    }
+
+    // Prices from index i until the model tag changes (or end) and returns where it
+    // stopped. The tag is checked in the pricing loop itself: a separate grouping pass
+    // over the book is memory bound and cost more than the exponential the kernels save.
+    template <CarryModel M>
+    size_t PriceRun(const vector<OptionParams>& book, size_t i, size_t end, vector<EuropeanResult>& out, BatchDomain* domain)
+    {
+        uint8_t code;
+        for (; i < end && book[i].model == M; ++i) {
+            out[i] = EuropeanKernel<M>(book[i], code);
+            if (domain)
+                domain->Set(i, code);
+        }
+        return i;
+    }
+
+    // A ladder step from u0 to u1 changes log(U / K) by 2 atanh(z), z = (u1 - u0) / (u1 + u0).
+    // For |z| below 0.01 four terms of the series are exact to rounding; larger steps
+    // return false and take a full log.
+    inline bool LogStep(double u0, double u1, double& logMoneyness)
+    {
+        double z = (u1 - u0) / (u1 + u0);
+        if (!(fabs(z) < 0.01))
+            return false;
+        double z2 = z * z;
+        logMoneyness += 2.0 * z * (1.0 + z2 * (1.0 / 3.0 + z2 * (1.0 / 5.0 + z2 * (1.0 / 7.0))));
+        return true;
+    }
+
+    // A fresh log every kLadderAnchor spots bounds the rounding the steps accumulate
+    const size_t kLadderAnchor = 64;
+}
+
+CarryTerms MakeCarryTerms(CarryModel model, double T, double r, double sigma, double b, bool withDiscount)
+{
+    switch (model) {
+    case CarryModel::BlackScholes: return MakeCarryTerms<CarryModel::BlackScholes>(T, r, sigma, b, withDiscount);
+    case CarryModel::Black76: return MakeCarryTerms<CarryModel::Black76>(T, r, sigma, b, withDiscount);
+    default: return MakeCarryTerms<CarryModel::Generic>(T, r, sigma, b, withDiscount);
+    }
+}
+
+vector<EuropeanResult> PriceEuropeanBatch(const vector<OptionParams>& book, BatchDomain* domain)
+{
+    INSTRUMENT_BATCH(Kernel::EuropeanPrice, book.size());
+
+    if (domain)
+        domain->Reset(book.size());
+    vector<EuropeanResult> out(book.size());
+    ParallelRows(book.size(), [&](size_t begin, size_t end) {
+        size_t i = begin;
+        while (i < end) {
+            switch (book[i].model) {
+            case CarryModel::BlackScholes: i = PriceRun<CarryModel::BlackScholes>(book, i, end, out, domain); break;
+            case CarryModel::Merton: i = PriceRun<CarryModel::Merton>(book, i, end, out, domain); break;
+            case CarryModel::Black76: i = PriceRun<CarryModel::Black76>(book, i, end, out, domain); break;
+            case CarryModel::GarmanKohlhagen: i = PriceRun<CarryModel::GarmanKohlhagen>(book, i, end, out, domain); break;
+            default: i = PriceRun<CarryModel::Generic>(book, i, end, out, domain); break;
+            }
+        }
+    });
+    if (domain)
+        domain->Finish();
+    return out;
+}
+
+SpotLadder PriceEuropeanLadder(const OptionParams& p, const vector<double>& spots, BatchDomain* domain)
+{
+    INSTRUMENT_BATCH(Kernel::EuropeanPrice, spots.size());
+
+    size_t n = spots.size();
+    SpotLadder out;
+    out.price.resize(n);
+    out.delta.resize(n);
+    out.gamma.resize(n);
+    if (domain)
+        domain->Reset(n);
+
+    // Everything but the spot is shared by the whole ladder, and so is the domain
+    // check of everything but the spot (see EuropeanKernel)
+    double b = p.model == CarryModel::BlackScholes ? p.r : (p.model == CarryModel::Black76 ? 0.0 : p.b);
+    RowDomain contract = ClassifyRow(1.0, p.K, p.T, p.r, p.sigma, b);
+    double K = contract.invalid ? 1.0 : p.K;
+    CarryTerms c = MakeCarryTerms(p.model, contract.expired ? 1.0 : p.T, p.r, contract.flat ? 1.0 : p.sigma, p.b);
+    double carry = contract.expired ? 1.0 : c.carry;
+    double discount = contract.expired ? 1.0 : c.discount;
+    double w = p.optType == "C" ? 1.0 : -1.0;
+    double strikeDiscount = K * discount;
+    double gammaScale = c.carry * kInvSqrt2Pi / c.sigmaSqrtT;
+
+    double logMoneyness = 0.0;  // log(U / K)
+    double previous = 1.0;      // the last safe spot
+    for (size_t i = 0; i < n; ++i) {
+        RowDomain d = contract;
+        d.invalid = contract.invalid || !(spots[i] > 0.0);
+        double U = d.invalid ? 1.0 : spots[i];
+        if (i % kLadderAnchor == 0 || !LogStep(previous, U, logMoneyness))
+            logMoneyness = log(U / K);
+        previous = U;
+
+        double d1 = (logMoneyness + c.drift) / c.sigmaSqrtT;
+        double d2 = d1 - c.sigmaSqrtT;
+        double exercise = (w * (U * carry - strikeDiscount) > 0.0) ? 1.0 : 0.0;
+        double Nd1 = d.Limit(CumNormal(w * d1), exercise);
+        double Nd2 = d.Limit(CumNormal(w * d2), exercise);
+
+        out.price[i] = d.Valid(w * (U * carry * Nd1 - strikeDiscount * Nd2));
+        out.delta[i] = d.Valid(w * carry * Nd1);
+        out.gamma[i] = d.Valid(d.Limit(gammaScale * exp(-0.5 * d1 * d1) / U, 0.0));
+        if (domain)
+            domain->Set(i, d.Code());
+    }
+    if (domain)
+        domain->Finish();
+    return out;
+}
+
+TimeRoll PriceEuropeanTimeRoll(const vector<OptionParams>& book, const vector<double>& offsets, BatchDomain* domain)
+{
+    size_t m = offsets.size();
+    INSTRUMENT_BATCH(Kernel::EuropeanPrice, book.size() * m);
+
+    TimeRoll out;
+    out.contracts = book.size();
+    out.dates = m;
+    out.values.resize(book.size() * m);
+    if (domain)
+        domain->Reset(out.values.size());
+    if (m == 0)
+        return out;
+
+    const double nan = numeric_limits<double>::quiet_NaN();
+    ParallelRows(book.size(), [&](size_t begin, size_t end) {
+        // Per-date factors of the current rate and carry; NaN forces the first fill
+        double rollRate = nan, rollCarry = nan;
+        vector<double> rateRoll(m), carryRoll(m);
+        vector<double> tau(m), sqrtTau(m);
+
+        for (size_t i = begin; i < end; ++i) {
+            const OptionParams& p = book[i];
+            double b = p.model == CarryModel::BlackScholes ? p.r : (p.model == CarryModel::Black76 ? 0.0 : p.b);
+            if (!(p.r == rollRate && b == rollCarry)) {
+                for (size_t j = 0; j < m; ++j) {
+                    rateRoll[j] = exp(p.r * offsets[j]);
+                    carryRoll[j] = exp((p.r - b) * offsets[j]);
+                }
+                rollRate = p.r;
+                rollCarry = b;
+            }
+
+            // Same masking as EuropeanKernel, with the expiry check moved to the dates
+            RowDomain contract = ClassifyRow(p.S, p.K, p.T, p.r, p.sigma, b);
+            double U = contract.invalid ? 1.0 : p.S;
+            double K = contract.invalid ? 1.0 : p.K;
+            double sigma = contract.flat ? 1.0 : p.sigma;
+            double w = p.optType == "C" ? 1.0 : -1.0;
+
+            double logMoneyness = log(U / K);
+            double discountT = exp(-p.r * p.T);
+            double carryT = exp((b - p.r) * p.T);
+            double driftRate = b + 0.5 * sigma * sigma;
+
+            for (size_t j = 0; j < m; ++j) {
+                tau[j] = p.T - offsets[j];
+                sqrtTau[j] = sqrt(tau[j] > 0.0 ? tau[j] : 1.0);
+            }
+
+            EuropeanResult* row = &out.values[i * m];
+            for (size_t j = 0; j < m; ++j) {
+                // A date at or past expiry takes the intrinsic value
+                RowDomain d = contract;
+                d.expired = !(tau[j] > 0.0);
+
+                double sigmaSqrtT = sigma * sqrtTau[j];
+                double d1 = (logMoneyness + driftRate * (d.expired ? 1.0 : tau[j])) / sigmaSqrtT;
+                double d2 = d1 - sigmaSqrtT;
+                double Nd1 = CumNormal(w * d1);
+                double Nd2 = CumNormal(w * d2);
+
+                double carry = d.expired ? 1.0 : carryT * carryRoll[j];
+                double discount = d.expired ? 1.0 : discountT * rateRoll[j];
+                double exercise = (w * (U * carry - K * discount) > 0.0) ? 1.0 : 0.0;
+                Nd1 = d.Limit(Nd1, exercise);
+                Nd2 = d.Limit(Nd2, exercise);
+
+                EuropeanResult& res = row[j];
+                res.price = d.Valid(w * (U * carry * Nd1 - K * discount * Nd2));
+                res.delta = d.Valid(w * carry * Nd1);
+                res.gamma = d.Valid(d.Limit(carry * kInvSqrt2Pi * exp(-0.5 * d1 * d1) / (U * sigmaSqrtT), 0.0));
+
+                if (domain)
+                    domain->Set(i * m + j, d.Code());
+            }
+        }
+    });
+    if (domain)
+        domain->Finish();
+    return out;
+}
+
+vector<EuropeanResult> PriceEuropeanBatchGeneric(const vector<OptionParams>& book, BatchDomain* domain)
+{
+    INSTRUMENT_BATCH(Kernel::EuropeanPrice, book.size());
+
+    if (domain)
+        domain->Reset(book.size());
+    vector<EuropeanResult> out(book.size());
+    ParallelRows(book.size(), [&](size_t begin, size_t end) {
+        uint8_t code;
+        for (size_t i = begin; i < end; ++i) {
+            out[i] = EuropeanKernel<CarryModel::Generic>(book[i], code);
+            if (domain)
+                domain->Set(i, code);
+        }
+    });
+    if (domain)
+        domain->Finish();
+    return out;
+}
+
+vector<size_t> GroupByModel(vector<OptionParams>& book)
+{
+    vector<size_t> position(book.size());
+    for (size_t i = 0; i < book.size(); ++i)
+        position[i] = i;
+
+    stable_sort(position.begin(), position.end(), [&book](size_t a, size_t c) {
+        return book[a].model < book[c].model;
+    });
+
+    vector<OptionParams> grouped;
+    grouped.reserve(book.size());
+    for (size_t i : position)
+        grouped.push_back(book[i]);
+    book.swap(grouped);
+
+    return position;
+}
@@ -0,0 +1,113 @@
+// CarryModels.hpp
+// Spot-independent terms of the European kernels specialised per cost-of-carry
+// model, and a batch pricer that groups a book by model before dispatching.
+
+#ifndef CarryModels_HPP
+#define CarryModels_HPP
+
+#include <cmath>
+#include <vector>
+#include "Domain.hpp"
+#include "Parameters.hpp"
+
+using namespace std;
+
+struct CarryTerms {
+    double sigmaSqrtT;  // sigma * sqrt(T)
+    double drift;       // (b + sigma^2 / 2) * T
+    double carry;       // exp((b - r) * T)
+    double discount;    // exp(-r * T)
+};
+
+// For BlackScholes and Black76 the model fixes b, so the b argument is ignored.
+// Merton and Garman-Kohlhagen take b = r - q (b = r - rf): exp((b - r) * T) is the
+// dividend (foreign) discount factor and nothing can be skipped. Delta and gamma do
+// not use the discount factor: with withDiscount false it is left at 0 and not
+// computed unless the model needs it for the carry (Black76).
+template <CarryModel M>
+inline CarryTerms MakeCarryTerms(double T, double r, double sigma, double b, bool withDiscount = true)
+{
+    CarryTerms c;
+    c.sigmaSqrtT = sigma * sqrt(T);
+    double halfVariance = 0.5 * sigma * sigma * T;
+
+    if (M == CarryModel::BlackScholes) {
+        // b = r: the carry factor is exactly 1
+        c.drift = r * T + halfVariance;
+        c.discount = withDiscount ? exp(-r * T) : 0.0;
+        c.carry = 1.0;
+    }
+    else if (M == CarryModel::Black76) {
+        // b = 0: the carry factor is the discount factor
+        c.drift = halfVariance;
+        c.discount = exp(-r * T);
+        c.carry = c.discount;
+    }
+    else {
+        c.drift = b * T + halfVariance;
+        c.discount = withDiscount ? exp(-r * T) : 0.0;
+        c.carry = exp((b - r) * T);
+    }
+    return c;
+}
+
+CarryTerms MakeCarryTerms(CarryModel model, double T, double r, double sigma, double b, bool withDiscount = true);
+
+struct EuropeanResult {
+    double price;
+    double delta;
+    double gamma;
+};
+
+// Prices every contract of the book at its own spot OptionParams::S, in book order.
+// Each run of contracts sharing a CarryModel goes through that model's specialised
+// loop, so a book grouped with GroupByModel dispatches once per model. Contracts
+// outside the formula's domain get the limits listed in Domain.hpp; with a domain
+// report the batch also records which rows were special-cased and why.
+vector<EuropeanResult> PriceEuropeanBatch(const vector<OptionParams>& book, BatchDomain* domain = nullptr);
+
+// Price, delta and gamma of one contract over a ladder of spots
+struct SpotLadder {
+    vector<double> price;
+    vector<double> delta;
+    vector<double> gamma;
+};
+
+// Evaluates contract p (p.S is ignored) at every spot in one pass. The carry and
+// discount terms are computed once, and log(U / K) is carried from one spot to the
+// next (see the comment in CarryModels.cpp), which suits the sorted and uniform
+// meshes of GenerateMeshArray. Spots and inputs outside the formula's domain get the
+// limits of Domain.hpp; the domain report, if any, has one row per spot.
+SpotLadder PriceEuropeanLadder(const OptionParams& p, const vector<double>& spots, BatchDomain* domain = nullptr);
+
+// Values of a book at later valuation dates under unchanged market inputs. Cell
+// (i, j) is contract i valued offsets[j] years from today, i.e. with T - offsets[j]
+// left to expiry; the cells are stored contract by contract.
+struct TimeRoll {
+    size_t contracts;
+    size_t dates;
+    vector<EuropeanResult> values;
+
+    const EuropeanResult& At(size_t contract, size_t date) const
+    {
+        return values[contract * dates + date];
+    }
+};
+
+// Evaluates every contract at every offset in one pass. log(S / K) is computed once
+// per contract, and the discount and carry factors of a date are the contract's
+// factors at T times exp(r * offset) and exp((r - b) * offset), which are kept while
+// the rate and carry stay the same, so a book grouped by curve computes them once.
+// A date at or past a contract's expiry gets the intrinsic value of Domain.hpp; the
+// domain report, if any, has one row per cell.
+TimeRoll PriceEuropeanTimeRoll(const vector<OptionParams>& book, const vector<double>& offsets,
+    BatchDomain* domain = nullptr);
+
+// Same as PriceEuropeanBatch but every contract goes through the generic kernel
+vector<EuropeanResult> PriceEuropeanBatchGeneric(const vector<OptionParams>& book, BatchDomain* domain = nullptr);
+
+// Stable-sorts the book by CarryModel; element i of the result is the original
+// position of the contract now at index i
+vector<size_t> GroupByModel(vector<OptionParams>& book);
+
+#endif // CarryModels_HPP
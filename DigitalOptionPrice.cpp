@@ -0,0 +1,191 @@
+
+#include "DigitalOptionPrice.hpp"
+#include "Instrumentation.hpp"
+#include "Scheduler.hpp"
+#include <cmath>
+#include <limits>
+
+DigitalOptionPrice::DigitalOptionPrice() {
+	init();
+}
+
+DigitalOptionPrice::DigitalOptionPrice(const DigitalOptionParams& p) {
+	K = p.K;
+	T = p.T;
+	r = p.r;
+	sigma = p.sigma;
+	b = p.b;
+	optType = p.optType;
+	S = p.S;
+	payoff = p.payoff;
+	cash = p.cash;
+}
+
+DigitalOptionPrice::~DigitalOptionPrice() {}
+
+void DigitalOptionPrice::init()
+{	// Initialise all default values
+	r = 0.05;
+	sigma = 0.2;
+	K = 100.0;
+	T = 1;
+	b = r;
+	optType = "C";
+	payoff = DigitalPayoff::CashOrNothing;
+	cash = 1.0;
+}
+
+// Kernel Functions (Haug: cash-or-nothing and asset-or-nothing options)
+DigitalTerms DigitalOptionPrice::Terms(double U, double K, double T, double r, double sigma, double b)
+{
+	const double invSqrt2 = 0.70710678118654752440;
+	const double invSqrt2Pi = 0.39894228040143267794;
+
+	DigitalTerms t;
+	t.sigmaSqrtT = sigma * sqrt(T);
+	t.d1 = (log(U / K) + (b + 0.5 * sigma * sigma) * T) / t.sigmaSqrtT;
+	t.d2 = t.d1 - t.sigmaSqrtT;
+	t.Nd1 = 0.5 * erfc(-t.d1 * invSqrt2);
+	t.Nd2 = 0.5 * erfc(-t.d2 * invSqrt2);
+	t.Nmd1 = 0.5 * erfc(t.d1 * invSqrt2);
+	t.Nmd2 = 0.5 * erfc(t.d2 * invSqrt2);
+	t.nd1 = invSqrt2Pi * exp(-0.5 * t.d1 * t.d1);
+	t.nd2 = invSqrt2Pi * exp(-0.5 * t.d2 * t.d2);
+	t.discount = exp(-r * T);
+	t.carry = exp((b - r) * T);
+	return t;
+}
+
+DigitalPrices DigitalOptionPrice::Prices(double U, const DigitalTerms& t, double cash)
+{
+	DigitalPrices p;
+	p.cashCall = cash * t.discount * t.Nd2;
+	p.cashPut = cash * t.discount * t.Nmd2;
+	p.assetCall = U * t.carry * t.Nd1;
+	p.assetPut = U * t.carry * t.Nmd1;
+	return p;
+}
+
+double DigitalOptionPrice::Price(double U) const
+{
+	INSTRUMENT_CALL(Kernel::DigitalPrice);
+	INSTRUMENT_DOMAIN(Kernel::DigitalPrice, T <= 0.0 || sigma <= 0.0 || U <= 0.0);
+
+	DigitalPrices p = Prices(U, Terms(U, K, T, r, sigma, b), cash);
+
+	double price;
+	if (payoff == DigitalPayoff::CashOrNothing)
+		price = (optType == "C") ? p.cashCall : p.cashPut;
+	else
+		price = (optType == "C") ? p.assetCall : p.assetPut;
+
+	INSTRUMENT_RESULT(Kernel::DigitalPrice, price);
+	return price;
+}
+
+// Cash call: X e^(-rT) n(d2) / (U sigma sqrt(T)). Asset call: e^((b-r)T) (N(d1) + n(d1) / (sigma sqrt(T))).
+// The puts follow from cash call + cash put = X e^(-rT) and asset call + asset put = U e^((b-r)T);
+// the asset put delta e^((b-r)T) (N(-d1) - n(d1) / (sigma sqrt(T))) keeps N(-d1) to avoid cancellation.
+double DigitalOptionPrice::Delta(double U) const
+{
+	INSTRUMENT_CALL(Kernel::DigitalDelta);
+	INSTRUMENT_DOMAIN(Kernel::DigitalDelta, T <= 0.0 || sigma <= 0.0 || U <= 0.0);
+
+	DigitalTerms t = Terms(U, K, T, r, sigma, b);
+
+	double delta;
+	if (payoff == DigitalPayoff::CashOrNothing) {
+		double callDelta = cash * t.discount * t.nd2 / (U * t.sigmaSqrtT);
+		delta = (optType == "C") ? callDelta : -callDelta;
+	}
+	else if (optType == "C")
+		delta = t.carry * (t.Nd1 + t.nd1 / t.sigmaSqrtT);
+	else
+		delta = t.carry * (t.Nmd1 - t.nd1 / t.sigmaSqrtT);
+
+	INSTRUMENT_RESULT(Kernel::DigitalDelta, delta);
+	return delta;
+}
+
+double DigitalOptionPrice::Gamma(double U) const
+{
+	INSTRUMENT_CALL(Kernel::DigitalGamma);
+	INSTRUMENT_DOMAIN(Kernel::DigitalGamma, T <= 0.0 || sigma <= 0.0 || U <= 0.0);
+
+	DigitalTerms t = Terms(U, K, T, r, sigma, b);
+	double variance = t.sigmaSqrtT * t.sigmaSqrtT;
+
+	double callGamma;
+	if (payoff == DigitalPayoff::CashOrNothing)
+		callGamma = -cash * t.discount * t.nd2 * t.d1 / (U * U * variance);
+	else
+		callGamma = -t.carry * t.nd1 * t.d2 / (U * variance);
+	double gamma = (optType == "C") ? callGamma : -callGamma;
+
+	INSTRUMENT_RESULT(Kernel::DigitalGamma, gamma);
+	return gamma;
+}
+
+// Two CDFs and the d-terms per Greek
+double DigitalOptionPrice::CostHint() const
+{
+	return 1.3;
+}
+
+vector<DigitalPrices> AllDigitalPayoffs(const vector<DigitalOptionParams>& book, BatchDomain* domain)
+{
+	INSTRUMENT_BATCH(Kernel::DigitalPrice, book.size());
+
+	if (domain)
+		domain->Reset(book.size());
+	vector<DigitalPrices> out(book.size());
+	ParallelRows(book.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const DigitalOptionParams& p = book[i];
+
+			// Degenerate rows run on safe inputs; at expiry and at zero volatility N(d1)
+			// and N(d2) become the indicator that the call finishes in the money
+			RowDomain d = ClassifyRow(p.S, p.K, p.T, p.r, p.sigma, p.b);
+			double U = d.invalid ? 1.0 : p.S;
+			double K = d.invalid ? 1.0 : p.K;
+
+			DigitalTerms t = DigitalOptionPrice::Terms(U, K, d.expired ? 1.0 : p.T, p.r, d.flat ? 1.0 : p.sigma, p.b);
+			t.carry = d.expired ? 1.0 : t.carry;
+			t.discount = d.expired ? 1.0 : t.discount;
+			double exercise = (U * t.carry - K * t.discount > 0.0) ? 1.0 : 0.0;
+			t.Nd1 = d.Limit(t.Nd1, exercise);
+			t.Nd2 = d.Limit(t.Nd2, exercise);
+			t.Nmd1 = d.Limit(t.Nmd1, 1.0 - exercise);
+			t.Nmd2 = d.Limit(t.Nmd2, 1.0 - exercise);
+
+			DigitalPrices v = DigitalOptionPrice::Prices(U, t, p.cash);
+			v.cashCall = d.Valid(v.cashCall);
+			v.cashPut = d.Valid(v.cashPut);
+			v.assetCall = d.Valid(v.assetCall);
+			v.assetPut = d.Valid(v.assetPut);
+			out[i] = v;
+
+			if (domain)
+				domain->Set(i, d.Code());
+		}
+	});
+	if (domain)
+		domain->Finish();
+	return out;
+}
+
+vector<double> PriceDigitalBatch(const vector<DigitalOptionParams>& book, BatchDomain* domain)
+{
+	vector<DigitalPrices> all = AllDigitalPayoffs(book, domain);
+
+	vector<double> out(book.size());
+	for (size_t i = 0; i < book.size(); ++i) {
+		const DigitalOptionParams& p = book[i];
+		bool call = p.optType == "C";
+		if (p.payoff == DigitalPayoff::CashOrNothing)
+			out[i] = call ? all[i].cashCall : all[i].cashPut;
+		else
+			out[i] = call ? all[i].assetCall : all[i].assetPut;
+	}
+	return out;
+}
@@ -0,0 +1,65 @@
+
+#ifndef DigitalOptionPrice_hpp
+#define DigitalOptionPrice_hpp
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include "Domain.hpp"
+#include "Parameters.hpp"
+#include "OptionPrice.hpp"
+
+// d-terms shared by every digital payoff of one contract
+struct DigitalTerms {
+    double d1;
+    double d2;
+    double Nd1;         // N(d1)
+    double Nd2;         // N(d2)
+    double Nmd1;        // N(-d1), from its own erfc: 1 - N(d1) loses the put's tail
+    double Nmd2;        // N(-d2)
+    double nd1;         // n(d1)
+    double nd2;         // n(d2)
+    double sigmaSqrtT;
+    double carry;       // exp((b - r) * T)
+    double discount;    // exp(-r * T)
+};
+
+// All four digital payoffs of one contract
+struct DigitalPrices {
+    double cashCall;
+    double cashPut;
+    double assetCall;
+    double assetPut;
+};
+
+class DigitalOptionPrice : public OptionPrice
+{
+private:
+    void init();
+
+public:
+    DigitalPayoff payoff;
+    double cash;        // Amount paid by a cash-or-nothing option
+
+    DigitalOptionPrice();
+    DigitalOptionPrice(const DigitalOptionParams& p);
+    virtual ~DigitalOptionPrice();
+
+    static DigitalTerms Terms(double U, double K, double T, double r, double sigma, double b);
+    static DigitalPrices Prices(double U, const DigitalTerms& t, double cash);
+
+    double Price(double U) const override;
+
+    double Delta(double U) const override;
+    double Gamma(double U) const override;
+    double CostHint() const override;
+};
+
+// Price of each contract of the book (its own payoff and type). Contracts outside
+// the domain are blended to their limits (see Domain.hpp).
+vector<double> PriceDigitalBatch(const vector<DigitalOptionParams>& book, BatchDomain* domain = nullptr);
+
+// All four payoffs of each contract from one set of d-terms
+vector<DigitalPrices> AllDigitalPayoffs(const vector<DigitalOptionParams>& book, BatchDomain* domain = nullptr);
+
+#endif
@@ -0,0 +1,118 @@
+// Domain.hpp
+// Inputs at which the closed forms break down, and the report the batch kernels
+// fill for them. The batch kernels evaluate a degenerate row on safe inputs and
+// blend in its limit value with masks, so the loop has no per-row fallback branch:
+//
+//   T = 0           intrinsic value (digitals: their payoff at expiry), gamma 0
+//   sigma = 0       payoff on the forward, discounted, gamma 0
+//   invalid         NaN: U <= 0, K <= 0, T < 0, sigma < 0, or any input NaN
+//   perpetual y1=1  b = r: the call is never exercised and is worth U
+//
+// A row that is both invalid and expired is reported as invalid. RowDomain is the
+// classification and blend every batch kernel shares.
+
+#ifndef Domain_HPP
+#define Domain_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace std;
+
+enum DomainCode : uint8_t {
+    DomainOk = 0,
+    DomainExpired = 1,
+    DomainZeroVol = 2,
+    DomainInvalid = 4,
+    DomainPerpetualUnit = 8
+};
+
+// Domain of one row. A kernel evaluates the row on safe inputs, replaces its N terms
+// by Limit and its outputs by Valid, and reports Code.
+struct RowDomain {
+    bool invalid;
+    bool expired;
+    bool flat;
+
+    bool Degenerate() const { return expired || flat; }
+
+    double Limit(double value, double limit) const
+    {
+        return Degenerate() ? limit : value;
+    }
+
+    double Valid(double value) const
+    {
+        return invalid ? numeric_limits<double>::quiet_NaN() : value;
+    }
+
+    uint8_t Code() const
+    {
+        return uint8_t(invalid ? DomainInvalid : (expired ? DomainExpired : (flat ? DomainZeroVol : DomainOk)));
+    }
+};
+
+// Inputs no formula accepts: a NaN, a non-positive spot or strike, a negative sigma
+inline bool InvalidInputs(double S, double K, double r, double sigma, double b)
+{
+    return !(S > 0.0) || !(K > 0.0) || !(sigma >= 0.0) || isnan(r) || isnan(b);
+}
+
+// Expired and flat only for an exact zero; a negative or NaN T or sigma is invalid
+inline RowDomain ClassifyRow(double S, double K, double T, double r, double sigma, double b)
+{
+    RowDomain d;
+    d.invalid = InvalidInputs(S, K, r, sigma, b) || !(T >= 0.0);
+    d.expired = T == 0.0;
+    d.flat = sigma == 0.0;
+    return d;
+}
+
+// Per-batch result of the domain checks. A kernel may call Set from several threads
+// on ranges of rows that start at multiples of 64 (see ParallelRows in Scheduler.hpp),
+// so Set only writes the row's code and its own bitmap word; Finish sets the union.
+struct BatchDomain {
+    vector<uint64_t> special;   // bit (i % 64) of word i / 64 is set if row i was special-cased
+    vector<uint8_t> codes;      // DomainCode of every row
+    uint8_t any = DomainOk;     // union of the codes, set by Finish
+
+    void Reset(size_t rows)
+    {
+        special.assign((rows + 63) / 64, 0);
+        codes.assign(rows, DomainOk);
+        any = DomainOk;
+    }
+
+    void Set(size_t row, uint8_t code)
+    {
+        codes[row] = code;
+        special[row / 64] |= uint64_t(code != DomainOk) << (row % 64);
+    }
+
+    // Called by the kernel after the last Set
+    void Finish()
+    {
+        any = DomainOk;
+        for (uint8_t code : codes)
+            any |= code;
+    }
+
+    bool Special(size_t row) const
+    {
+        return (special[row / 64] >> (row % 64)) & 1;
+    }
+
+    size_t Count() const
+    {
+        size_t count = 0;
+        for (uint64_t word : special)
+            for (; word; word &= word - 1)
+                ++count;
+        return count;
+    }
+};
+
+#endif // Domain_HPP
@@ -3,7 +3,11 @@
 #include <cmath>
 #include <iostream>
 #include <vector>
+#include <stdexcept>
 #include "Parameters.hpp"
+#include "Instrumentation.hpp"
+#include "CarryModels.hpp"
+#include "TermStructure.hpp"
 
 
 
@@ -14,68 +18,70 @@ EuropeanOptionPrice::EuropeanOptionPrice() {
 
 double EuropeanOptionPrice::N(double x) const
 {
-	// Cumulative standard normal distribution using the error function
-	return 0.5 * (1.0 + std::erf(x / std::sqrt(2.0)));
+	// Cumulative standard normal distribution using the complementary error function
+	// (1 + erf(x) cancels in the left tail, which loses the deep OTM prices)
+	return 0.5 * std::erfc(-x / std::sqrt(2.0));
 }
 
 double EuropeanOptionPrice::n(double x) const
 {
 
-	double A = 1.0 / sqrt(2.0 * 3.1415);
+	const double A = 0.39894228040143267794;	// 1 / sqrt(2 pi)
 	return A * exp(-x * x * 0.5);
 
 }
 
 // Kernel Functions (Haug)
+// The spot-independent terms come from MakeCarryTerms, which skips the carry
+// exponential when the model tag fixes b (BlackScholes: b = r, Black76: b = 0).
+// Delta and gamma do not ask for the discount factor.
 double EuropeanOptionPrice::CallPrice(double U) const
 {
-	double tmp = sigma * sqrt(T);
+	CarryTerms c = MakeCarryTerms(model, T, r, sigma, b);
 
-	double d1 = (log(U / K) + (b + 0.5 * pow(sigma, 2)) * T) / tmp;
-	double d2 = d1 - tmp;
+	double d1 = (log(U / K) + c.drift) / c.sigmaSqrtT;
+	double d2 = d1 - c.sigmaSqrtT;
 
-	return (U * exp((b - r) * T) * N(d1)) - (K * exp(-r * T) * N(d2));
+	return (U * c.carry * N(d1)) - (K * c.discount * N(d2));
 }
 
 double EuropeanOptionPrice::PutPrice(double U) const
 {
+	CarryTerms c = MakeCarryTerms(model, T, r, sigma, b);
 
-	double tmp = sigma * sqrt(T);
-	double d1 = (log(U / K) + (b + (sigma * sigma) * 0.5) * T) / tmp;
-	double d2 = d1 - tmp;
+	double d1 = (log(U / K) + c.drift) / c.sigmaSqrtT;
+	double d2 = d1 - c.sigmaSqrtT;
 
-	return (K * exp(-r * T) * N(-d2)) - (U * exp((b - r) * T) * N(-d1));
+	return (K * c.discount * N(-d2)) - (U * c.carry * N(-d1));
 
 }
 
 
 double EuropeanOptionPrice::CallDelta(double U) const
 {
-	double tmp = sigma * sqrt(T);
+	CarryTerms c = MakeCarryTerms(model, T, r, sigma, b, false);
 
-	double d1 = (log(U / K) + (b + (sigma * sigma) * 0.5) * T) / tmp;
+	double d1 = (log(U / K) + c.drift) / c.sigmaSqrtT;
 
-
-	return exp((b - r) * T) * N(d1);
+	return c.carry * N(d1);
 }
 
 double EuropeanOptionPrice::PutDelta(double U) const
 {
-	double tmp = sigma * sqrt(T);
+	CarryTerms c = MakeCarryTerms(model, T, r, sigma, b, false);
 
-	double d1 = (log(U / K) + (b + (sigma * sigma) * 0.5) * T) / tmp;
+	double d1 = (log(U / K) + c.drift) / c.sigmaSqrtT;
 
-	return exp((b - r) * T) * (N(d1) - 1.0);
+	return -c.carry * N(-d1);
 }
 
 double EuropeanOptionPrice::PutCallGamma(double U) const
 {
+	CarryTerms c = MakeCarryTerms(model, T, r, sigma, b, false);
 
-	double tmp = sigma * sqrt(T);
-
-	double d1 = (log(U / K) + (b + (sigma * sigma) * 0.5) * T) / tmp;
+	double d1 = (log(U / K) + c.drift) / c.sigmaSqrtT;
 
-	return (n(d1) * exp((b - r) * T)) / (U * tmp);
+	return (n(d1) * c.carry) / (U * c.sigmaSqrtT);
 }
 
 
@@ -98,6 +104,7 @@ void EuropeanOptionPrice::copy(const EuropeanOptionPrice& o2)
 	T = o2.T;
 	b = o2.b;
 	optType = o2.optType;
+	model = o2.model;
 }
 
 // Copy constructor
@@ -121,16 +128,23 @@ EuropeanOptionPrice& EuropeanOptionPrice::operator = (const EuropeanOptionPrice&
 
 double EuropeanOptionPrice::Price(double U) const
 {
+	INSTRUMENT_CALL(Kernel::EuropeanPrice);
+	INSTRUMENT_DOMAIN(Kernel::EuropeanPrice, T <= 0.0 || sigma <= 0.0 || U <= 0.0);
+
+	double price;
 	if (optType == "C")
 	{
 		//cout << "calling call\n";
-		return CallPrice(U);
+		price = CallPrice(U);
 	}
 	else
 	{
 		//cout << "calling put\n";
-		return PutPrice(U);
+		price = PutPrice(U);
 	}
+
+	INSTRUMENT_RESULT(Kernel::EuropeanPrice, price);
+	return price;
 }
 
 
@@ -151,17 +165,37 @@ EuropeanOptionPrice::EuropeanOptionPrice(const OptionParams& p) {
 	sigma = p.sigma;
 	b = p.b;
 	optType = p.optType;
+	model = p.model;
 	S = p.S;
 }
 
+EuropeanOptionPrice::EuropeanOptionPrice(const OptionParams& p, const TermStructure& rate,
+	const TermStructure& carry, const TermStructure& variance) : EuropeanOptionPrice(p) {
+	if (variance.Minimum() < 0.0)
+		throw invalid_argument("EuropeanOptionPrice: the variance curve goes negative");
+	r = rate.Average(T);
+	b = carry.Average(T);
+	sigma = sqrt(variance.Average(T));
+	model = CarryModel::Generic;	// the carry curve decides b
+}
+
 double EuropeanOptionPrice::Delta(double U) const {
-    if (optType == "C")
-        return CallDelta(U);
-    else
-        return PutDelta(U);
+    INSTRUMENT_CALL(Kernel::EuropeanDelta);
+    INSTRUMENT_DOMAIN(Kernel::EuropeanDelta, T <= 0.0 || sigma <= 0.0 || U <= 0.0);
+
+    double delta = (optType == "C") ? CallDelta(U) : PutDelta(U);
+
+    INSTRUMENT_RESULT(Kernel::EuropeanDelta, delta);
+    return delta;
 }
 
 double EuropeanOptionPrice::Gamma(double U) const {
-    return PutCallGamma(U);
+    INSTRUMENT_CALL(Kernel::EuropeanGamma);
+    INSTRUMENT_DOMAIN(Kernel::EuropeanGamma, T <= 0.0 || sigma <= 0.0 || U <= 0.0);
+
+    double gamma = PutCallGamma(U);
+
+    INSTRUMENT_RESULT(Kernel::EuropeanGamma, gamma);
+    return gamma;
 }
 
@@ -9,6 +9,7 @@
 #include "Parameters.hpp"
 #include "OptionPrice.hpp"
 
+class TermStructure;
 
 
 class EuropeanOptionPrice : public OptionPrice
@@ -34,6 +35,9 @@ public:
     EuropeanOptionPrice();
     EuropeanOptionPrice(const string& optionType);
     EuropeanOptionPrice(const OptionParams& p);
+    // r, b and sigma are the flat equivalents of the curves up to p.T
+    EuropeanOptionPrice(const OptionParams& p, const TermStructure& rate,
+        const TermStructure& carry, const TermStructure& variance);
     EuropeanOptionPrice(const EuropeanOptionPrice& option2);
     virtual ~EuropeanOptionPrice();
 
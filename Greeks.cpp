@@ -1,4 +1,6 @@
 #include "Greeks.hpp"
+#include "Report.hpp"
+#include "Scheduler.hpp"
 #include <iomanip>
 #include <cmath>
 
@@ -17,6 +19,24 @@ double GreekCalculator::GammaFD(double S, double h) const {
     return (price_plus - 2 * price + price_minus) / (h * h);
 }
 
+vector<double> GreekCalculator::DeltaFD(const vector<double>& spots, double h) const {
+    vector<double> out(spots.size());
+    Scheduler::Shared().ParallelFor(spots.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            out[i] = DeltaFD(spots[i], h);
+    }, kMeshGrain);
+    return out;
+}
+
+vector<double> GreekCalculator::GammaFD(const vector<double>& spots, double h) const {
+    vector<double> out(spots.size());
+    Scheduler::Shared().ParallelFor(spots.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            out[i] = GammaFD(spots[i], h);
+    }, kMeshGrain);
+    return out;
+}
+
 void GreekCalculator::CompareDelta(double S, const std::vector<double>& h_vals) const {
     cout << "Delta (Analytical): " << option.Delta(S) << "\n";
     for (double h : h_vals) {
@@ -52,58 +72,79 @@ void GreekCalculator::CompareAllGreeks(double S, const vector<double>& h_vals, O
 
 
 void GreekCalculator::ComputeGreeks(const vector<double>& S_mesh, OptionParams p) {
-    for (double S : S_mesh) {
-        p.S = S;
-
-        EuropeanOptionPrice option(p);
-        double c = option.Price(S);
-        double d = option.Delta(S);
-
-        option.toggle();
-        double put = option.Price(S);
-        double put_d = option.Delta(S);
-
-        double g = option.Gamma(S);
-
-        std::cout << "S: " << S
-            << " | Call: " << c << " | Delta (Call): " << d
-            << " | Put: " << put << " | Delta (Put): " << put_d
-            << "| Gamma: " << g << std::endl;
+    // The mesh is priced on the Scheduler, then formatted in order. Numbers follow
+    // the current format of cout, as they did when streamed directly; the lines are
+    // collected in one buffer and written once
+    struct Row { double c, d, put, put_d, g; };
+    vector<Row> rows(S_mesh.size());
+    Scheduler::Shared().ParallelFor(S_mesh.size(), [&](size_t begin, size_t end) {
+        OptionParams q = p;
+        for (size_t i = begin; i < end; ++i) {
+            double S = S_mesh[i];
+            q.S = S;
+
+            EuropeanOptionPrice option(q);
+            Row& row = rows[i];
+            row.c = option.Price(S);
+            row.d = option.Delta(S);
+
+            option.toggle();
+            row.put = option.Price(S);
+            row.put_d = option.Delta(S);
+
+            row.g = option.Gamma(S);
+        }
+    }, kMeshGrain);
+
+    ReportBuffer out;
+    for (size_t i = 0; i < S_mesh.size(); ++i) {
+        const Row& row = rows[i];
+        out.Append("S: ").Like(cout, S_mesh[i])
+            .Append(" | Call: ").Like(cout, row.c).Append(" | Delta (Call): ").Like(cout, row.d)
+            .Append(" | Put: ").Like(cout, row.put).Append(" | Delta (Put): ").Like(cout, row.put_d)
+            .Append("| Gamma: ").Like(cout, row.g).Append('\n');
     }
+    out.Flush(cout);
 }
 
 void GreekCalculator::DeltaApprox(const vector<double>& S_mesh, OptionParams p) {
-    for (double S : S_mesh) {
-        p.S = S;
-        double h = 0.01;
-
-        EuropeanOptionPrice callOption(p);
-
-        double V_plus_call = callOption.Price(S + h);
-        double V_minus_call = callOption.Price(S - h);
-        double V_center_call = callOption.Price(S);
-
-        double delta_call = (V_plus_call - V_minus_call) / (2 * h);
-        double gamma_call = (V_plus_call - 2 * V_center_call + V_minus_call) / (h * h);
-        double analytic_delta_call = callOption.Delta(S);
-        double c = V_center_call;
-
-        callOption.toggle();  // now it's a PUT
-
-        double V_plus_put = callOption.Price(S + h);
-        double V_minus_put = callOption.Price(S - h);
-        double V_center_put = callOption.Price(S);
-
-        double delta_put = (V_plus_put - V_minus_put) / (2 * h);
-        double gamma_put = (V_plus_put - 2 * V_center_put + V_minus_put) / (h * h);
-
-        double analytic_delta_put = callOption.Delta(S);
-        double put = V_center_put;
-
-        cout << fixed << setprecision(4);
-        cout << "S: " << S
-            << " | Call: " << c << " | Delta (Call): " << delta_call
-            << " | Put: " << put << " | Delta (Put): " << delta_put
-            << "| Gamma: " << gamma_call << endl;
+    struct Row { double c, delta_call, gamma_call, put, delta_put; };
+    vector<Row> rows(S_mesh.size());
+    Scheduler::Shared().ParallelFor(S_mesh.size(), [&](size_t begin, size_t end) {
+        OptionParams q = p;
+        for (size_t i = begin; i < end; ++i) {
+            double S = S_mesh[i];
+            q.S = S;
+            double h = 0.01;
+
+            EuropeanOptionPrice callOption(q);
+
+            double V_plus_call = callOption.Price(S + h);
+            double V_minus_call = callOption.Price(S - h);
+            double V_center_call = callOption.Price(S);
+
+            Row& row = rows[i];
+            row.delta_call = (V_plus_call - V_minus_call) / (2 * h);
+            row.gamma_call = (V_plus_call - 2 * V_center_call + V_minus_call) / (h * h);
+            row.c = V_center_call;
+
+            callOption.toggle();  // now it's a PUT
+
+            double V_plus_put = callOption.Price(S + h);
+            double V_minus_put = callOption.Price(S - h);
+
+            row.delta_put = (V_plus_put - V_minus_put) / (2 * h);
+            row.put = callOption.Price(S);
+        }
+    }, kMeshGrain);
+
+    ReportBuffer out;
+    for (size_t i = 0; i < S_mesh.size(); ++i) {
+        const Row& row = rows[i];
+        out.Append("S: ").Fixed(S_mesh[i], 4)
+            .Append(" | Call: ").Fixed(row.c, 4).Append(" | Delta (Call): ").Fixed(row.delta_call, 4)
+            .Append(" | Put: ").Fixed(row.put, 4).Append(" | Delta (Put): ").Fixed(row.delta_put, 4)
+            .Append("| Gamma: ").Fixed(row.gamma_call, 4).Append('\n');
     }
+    out.Flush(cout);
 }
@@ -8,6 +8,10 @@
 
 using namespace std;
 
+// Spots per task when a mesh is evaluated on the Scheduler; a mesh point costs a
+// few prices, so small meshes such as the demo's stay on the calling thread
+const size_t kMeshGrain = 256;
+
 class GreekCalculator {
 private:
     const OptionPrice& option;
@@ -19,6 +23,10 @@ public:
     double DeltaFD(double S, double h) const;
     double GammaFD(double S, double h) const;
 
+    // The same at every spot, in ranges of kMeshGrain spots on the shared Scheduler
+    vector<double> DeltaFD(const vector<double>& spots, double h) const;
+    vector<double> GammaFD(const vector<double>& spots, double h) const;
+
     void CompareDelta(double S, const vector<double>& h_vals) const;
     void CompareGamma(double S, const vector<double>& h_vals) const;
 
@@ -0,0 +1,420 @@
+// GridSnapshot.cpp
+#include "GridSnapshot.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    // File layout: Header, Header::sections entries sorted by key, the input bytes of
+    // every section, then the values of every section starting on a 64-byte boundary
+    const char kMagic[8] = { 'O', 'P', 'T', 'G', 'R', 'I', 'D', '\0' };
+    const uint32_t kVersion = 2;
+    // Bump whenever a kernel below changes its results, so older snapshots are rejected
+    const uint32_t kKernelVersion = 1;
+    const uint64_t kAlign = 64;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entryBytes;    // sizeof the entry the writer used
+        uint32_t kernel;        // kKernelVersion of the writer
+        uint32_t reserved;
+        uint64_t sections;
+        uint64_t fileBytes;
+    };
+
+    uint64_t AlignUp(uint64_t n)
+    {
+        return (n + kAlign - 1) / kAlign * kAlign;
+    }
+
+    // FNV-1a over a tag and the raw bytes of the inputs; vector lengths are hashed
+    // too, so different axes never concatenate to the same byte string. The bytes
+    // are kept as well, for the exact comparison on lookup.
+    class KeyHash
+    {
+    private:
+        uint64_t h = 14695981039346656037ull;
+        string inputs;
+
+        void Bytes(const void* data, size_t n)
+        {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < n; ++i) {
+                h ^= p[i];
+                h *= 1099511628211ull;
+            }
+            inputs.append(static_cast<const char*>(data), n);
+        }
+
+    public:
+        explicit KeyHash(const char* tag) { Bytes(tag, strlen(tag) + 1); }
+
+        KeyHash& Add(double v) { Bytes(&v, sizeof(v)); return *this; }
+        KeyHash& Add(const string& s) { Bytes(s.c_str(), s.size() + 1); return *this; }
+        KeyHash& Add(const vector<double>& v)
+        {
+            uint64_t n = v.size();
+            Bytes(&n, sizeof(n));
+            Bytes(v.data(), v.size() * sizeof(double));
+            return *this;
+        }
+
+        uint64_t Value() const { return h; }
+        const string& Inputs() const { return inputs; }
+    };
+
+    // The kernels below repeat EuropeanOptionPrice (b = r, so the carry factor is 1)
+    // and AmericanOptionPrice operation for operation, so the grids are bit-identical
+    inline double N(double x)
+    {
+        return 0.5 * erfc(-x / sqrt(2.0));
+    }
+
+    inline double n(double x)
+    {
+        const double A = 0.39894228040143267794;    // 1 / sqrt(2 pi)
+        return A * exp(-x * x * 0.5);
+    }
+}
+
+GridSnapshot::GridSnapshot()
+    : base(nullptr), bytes(0), entries(nullptr), entryCount(0)
+{
+}
+
+GridSnapshot::~GridSnapshot()
+{
+    Detach();
+}
+
+void GridSnapshot::Detach()
+{
+#ifndef _WIN32
+    if (base && copy.empty())
+        munmap(const_cast<char*>(base), bytes);
+#endif
+    copy.clear();
+    base = nullptr;
+    bytes = 0;
+    entries = nullptr;
+    entryCount = 0;
+}
+
+bool GridSnapshot::Attach(const string& path)
+{
+    Detach();
+
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    base = static_cast<const char*>(p);
+    bytes = size_t(st.st_size);
+#else
+    ifstream in(path, ios::binary);
+    if (!in)
+        return false;
+    copy.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    if (copy.size() < sizeof(Header)) {
+        copy.clear();
+        return false;
+    }
+    base = copy.data();
+    bytes = copy.size();
+#endif
+
+    // Everything the lookups rely on is checked once here
+    Header h;
+    memcpy(&h, base, sizeof(h));
+    bool valid = memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 && h.version == kVersion
+        && h.entryBytes == sizeof(Entry) && h.kernel == kKernelVersion && h.fileBytes == bytes
+        && h.sections <= (bytes - sizeof(Header)) / sizeof(Entry);
+    if (valid) {
+        entries = reinterpret_cast<const Entry*>(base + sizeof(Header));
+        entryCount = size_t(h.sections);
+        for (size_t i = 0; valid && i < entryCount; ++i) {
+            const Entry& e = entries[i];
+            valid = e.offset % kAlign == 0 && e.offset <= bytes && e.count <= (bytes - e.offset) / sizeof(double)
+                && e.inputOffset <= bytes && e.inputBytes <= bytes - e.inputOffset
+                && (i == 0 || entries[i - 1].key <= e.key);
+        }
+    }
+    if (!valid) {
+        Detach();
+        return false;
+    }
+    return true;
+}
+
+GridView GridSnapshot::Find(uint64_t key, const string& inputs) const
+{
+    // Sections whose keys collide sit next to each other; only equal inputs match
+    const Entry* end = entries + entryCount;
+    const Entry* e = lower_bound(entries, end, key, [](const Entry& a, uint64_t k) { return a.key < k; });
+    for (; e != end && e->key == key; ++e) {
+        if (e->inputBytes == inputs.size() && memcmp(base + e->inputOffset, inputs.data(), inputs.size()) == 0)
+            return { reinterpret_cast<const double*>(base + e->offset), size_t(e->count) };
+    }
+    return GridView();
+}
+
+size_t GridSnapshot::Sections() const
+{
+    return entryCount;
+}
+
+bool GridSnapshot::Write(const string& path, const vector<GridSection>& sections)
+{
+    vector<const GridSection*> sorted;
+    for (const GridSection& section : sections)
+        sorted.push_back(&section);
+    stable_sort(sorted.begin(), sorted.end(),
+        [](const GridSection* a, const GridSection* b) { return a->key < b->key; });
+
+    vector<Entry> table(sorted.size());
+    uint64_t inputOffset = sizeof(Header) + table.size() * sizeof(Entry);
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        table[i].inputOffset = inputOffset;
+        table[i].inputBytes = sorted[i]->inputs.size();
+        inputOffset += sorted[i]->inputs.size();
+    }
+    uint64_t offset = AlignUp(inputOffset);
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        table[i].key = sorted[i]->key;
+        table[i].offset = offset;
+        table[i].count = sorted[i]->values.size;
+        offset = AlignUp(offset + sorted[i]->values.size * sizeof(double));
+    }
+
+    Header h;
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.entryBytes = sizeof(Entry);
+    h.kernel = kKernelVersion;
+    h.reserved = 0;
+    h.sections = table.size();
+    h.fileBytes = offset;
+
+    string tmp = path + ".tmp";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+        const char zeros[kAlign] = {};
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(table.data()), streamsize(table.size() * sizeof(Entry)));
+        for (const GridSection* section : sorted)
+            out.write(section->inputs.data(), streamsize(section->inputs.size()));
+        uint64_t written = inputOffset;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            out.write(zeros, streamsize(table[i].offset - written));
+            out.write(reinterpret_cast<const char*>(sorted[i]->values.data),
+                streamsize(sorted[i]->values.size * sizeof(double)));
+            written = table[i].offset + sorted[i]->values.size * sizeof(double);
+        }
+        out.write(zeros, streamsize(offset - written));
+        if (!out.flush()) {
+            out.close();
+            remove(tmp.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+GridCache::GridCache()
+{
+}
+
+GridCache::GridCache(const string& path)
+{
+    Attach(path);
+}
+
+bool GridCache::Attach(const string& path)
+{
+    used.clear();
+    return snapshot.Attach(path);
+}
+
+// The snapshot's section if its inputs and size match, else build(values) fills a new one
+template <typename Build>
+GridView GridCache::Section(uint64_t key, const string& inputs, size_t count, Build build)
+{
+    auto it = used.find(inputs);
+    if (it != used.end())
+        return it->second.values;
+
+    GridView v = snapshot.Find(key, inputs);
+    if (v.data && v.size == count) {
+        ++stats.mapped;
+    }
+    else {
+        vector<double>& values = computed[inputs];
+        values.assign(count, 0.0);
+        build(values.data());
+        v = { values.data(), count };
+        ++stats.computed;
+    }
+    used[inputs] = { key, inputs, v };
+    return v;
+}
+
+// log(S / K) per strike
+GridView GridCache::LogMoneyness(double S, const vector<double>& strikes)
+{
+    KeyHash key = KeyHash("log_moneyness").Add(S).Add(strikes);
+    return Section(key.Value(), key.Inputs(), strikes.size(), [&](double* out) {
+        for (size_t k = 0; k < strikes.size(); ++k)
+            out[k] = log(S / strikes[k]);
+    });
+}
+
+// sigma sqrt(T) for each [expiry][volatility], followed by sigma^2 T / 2 in the same layout
+GridView GridCache::VolTerms(const vector<double>& volatilities, const vector<double>& expiryTimes)
+{
+    size_t cells = expiryTimes.size() * volatilities.size();
+    KeyHash key = KeyHash("vol_terms").Add(volatilities).Add(expiryTimes);
+    return Section(key.Value(), key.Inputs(), 2 * cells, [&](double* out) {
+        for (size_t t = 0; t < expiryTimes.size(); ++t) {
+            double T = expiryTimes[t];
+            for (size_t v = 0; v < volatilities.size(); ++v) {
+                double sigma = volatilities[v];
+                out[t * volatilities.size() + v] = sigma * sqrt(T);
+                out[cells + t * volatilities.size() + v] = 0.5 * sigma * sigma * T;
+            }
+        }
+    });
+}
+
+// r T for each expiry, followed by the discount factors exp(-r T)
+GridView GridCache::RateTerms(double r, const vector<double>& expiryTimes)
+{
+    size_t count = expiryTimes.size();
+    KeyHash key = KeyHash("rate_terms").Add(r).Add(expiryTimes);
+    return Section(key.Value(), key.Inputs(), 2 * count, [&](double* out) {
+        for (size_t t = 0; t < count; ++t) {
+            out[t] = r * expiryTimes[t];
+            out[count + t] = exp(-r * expiryTimes[t]);
+        }
+    });
+}
+
+// y1 (calls) or y2 (puts) per volatility
+GridView GridCache::PerpetualExponents(double r, double b, const vector<double>& volatilities, const string& optType)
+{
+    KeyHash key = KeyHash("perpetual_exponent").Add(optType).Add(r).Add(b).Add(volatilities);
+    return Section(key.Value(), key.Inputs(), volatilities.size(), [&](double* out) {
+        for (size_t v = 0; v < volatilities.size(); ++v) {
+            double sigma = volatilities[v];
+            double tmp = b / (sigma * sigma);
+            double d = (tmp - 0.5) * (tmp - 0.5);
+            double root = sqrt(d + ((2 * r) / (sigma * sigma)));
+            out[v] = (optType == "C") ? 0.5 - tmp + root : 0.5 - tmp - root;
+        }
+    });
+}
+
+GridView GridCache::OptionMatrix(double S, double r,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const vector<double>& expiryTimes,
+    MatrixGreek greek)
+{
+    // The invariants are looked up even when the grid is in the snapshot, so that
+    // Save() keeps them for a later change of r, S or the axes
+    GridView logM = LogMoneyness(S, strikes);
+    GridView vol = VolTerms(volatilities, expiryTimes);
+    GridView rate = RateTerms(r, expiryTimes);
+
+    size_t nk = strikes.size(), nv = volatilities.size(), nt = expiryTimes.size();
+    KeyHash key = KeyHash("european").Add(double(int(greek))).Add(S).Add(r)
+        .Add(strikes).Add(volatilities).Add(expiryTimes);
+
+    return Section(key.Value(), key.Inputs(), nt * nk * nv, [&](double* out) {
+        const double* sigmaSqrtT = vol.data;
+        const double* halfVariance = vol.data + nt * nv;
+        const double* discount = rate.data + nt;
+        for (size_t t = 0; t < nt; ++t) {
+            for (size_t k = 0; k < nk; ++k) {
+                double K = strikes[k];
+                for (size_t v = 0; v < nv; ++v) {
+                    double sst = sigmaSqrtT[t * nv + v];
+                    double d1 = (logM.data[k] + (rate.data[t] + halfVariance[t * nv + v])) / sst;
+                    double value;
+                    if (greek == MatrixGreek::Price)
+                        value = S * N(d1) - K * discount[t] * N(d1 - sst);
+                    else if (greek == MatrixGreek::Delta)
+                        value = N(d1);
+                    else
+                        value = n(d1) / (S * sst);
+                    *out++ = value;
+                }
+            }
+        }
+    });
+}
+
+GridView GridCache::PerpetualMatrix(double S, double r,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    double b,
+    const string& optType)
+{
+    GridView exponents = PerpetualExponents(r, b, volatilities, optType);
+
+    KeyHash key = KeyHash("perpetual").Add(optType).Add(S).Add(r).Add(b)
+        .Add(strikes).Add(volatilities);
+
+    return Section(key.Value(), key.Inputs(), strikes.size() * volatilities.size(), [&](double* out) {
+        bool call = optType == "C";
+        for (double K : strikes) {
+            for (size_t v = 0; v < volatilities.size(); ++v) {
+                double y = exponents.data[v];
+                double term1 = call ? K / (y - 1) : K / (1 - y);
+                *out++ = term1 * pow(((y - 1) / y) * (S / K), y);
+            }
+        }
+    });
+}
+
+bool GridCache::Save(const string& path) const
+{
+    vector<GridSection> sections;
+    for (const auto& entry : used)
+        sections.push_back(entry.second);
+    return GridSnapshot::Write(path, sections);
+}
+
+const GridCacheStats& GridCache::Stats() const
+{
+    return stats;
+}
@@ -0,0 +1,135 @@
+// GridSnapshot.hpp
+// Persistent cache of the OptionMatrix grids. Every grid, and every per-contract
+// invariant the grids are built from, is one section of a snapshot file keyed by a
+// 64-bit hash of exactly the inputs it depends on. The section also stores those
+// inputs, and a lookup compares them, so a hash collision is a miss rather than a
+// wrong grid. A new process maps the file
+// read-only and uses the matching sections in place. A section whose inputs changed
+// is rebuilt, and it reuses the invariants that are still valid: after a change of r
+// only the discount terms and the grids are recomputed, while log(S / K) and
+// sigma sqrt(T) come from the snapshot.
+//
+// The file is raw doubles in the byte order of the machine that wrote it; a file
+// that is missing, truncated, not a snapshot, or written by another format or kernel
+// version is treated as empty.
+
+#ifndef GridSnapshot_HPP
+#define GridSnapshot_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "OptionMatrix.hpp"
+
+using namespace std;
+
+// Values of one section; they live in the mapping or in the cache that returned them
+struct GridView {
+    const double* data = nullptr;
+    size_t size = 0;
+};
+
+// One section as it is written: its key, the input bytes the key was hashed from,
+// and its values
+struct GridSection {
+    uint64_t key;
+    string inputs;
+    GridView values;
+};
+
+// A snapshot file mapped read-only
+class GridSnapshot
+{
+private:
+    struct Entry {
+        uint64_t key;
+        uint64_t offset;        // bytes from the start of the file
+        uint64_t count;         // doubles
+        uint64_t inputOffset;   // the section's input bytes
+        uint64_t inputBytes;
+    };
+
+    const char* base;
+    size_t bytes;
+    vector<char> copy;      // the file contents where there is no mmap
+    const Entry* entries;
+    size_t entryCount;
+
+public:
+    GridSnapshot();
+    ~GridSnapshot();
+
+    GridSnapshot(const GridSnapshot&) = delete;
+    GridSnapshot& operator = (const GridSnapshot&) = delete;
+
+    // Replaces the current mapping. Returns false, leaving the snapshot empty, if
+    // the file cannot be read or is not a valid snapshot.
+    bool Attach(const string& path);
+    void Detach();
+
+    // Empty view if the snapshot has no section with this key and these inputs
+    GridView Find(uint64_t key, const string& inputs) const;
+    size_t Sections() const;
+
+    // Writes the sections to path + ".tmp" and renames it over path, so readers
+    // never see a partial file
+    static bool Write(const string& path, const vector<GridSection>& sections);
+};
+
+struct GridCacheStats {
+    size_t mapped = 0;      // sections served from the snapshot
+    size_t computed = 0;    // sections computed by this process
+};
+
+// The OptionMatrix grids served from a snapshot when their inputs match and computed
+// (then kept in memory) otherwise. The values are identical to ComputeOptionMatrix
+// and ComputePerpetualMatrix.
+class GridCache
+{
+private:
+    // Both maps are keyed by the input bytes, so they never confuse two sections
+    // whose hashes collide
+    GridSnapshot snapshot;
+    map<string, vector<double>> computed;
+    map<string, GridSection> used;          // every section handed out, for Save()
+    GridCacheStats stats;
+
+    template <typename Build>
+    GridView Section(uint64_t key, const string& inputs, size_t count, Build build);
+
+    GridView LogMoneyness(double S, const vector<double>& strikes);
+    GridView VolTerms(const vector<double>& volatilities, const vector<double>& expiryTimes);
+    GridView RateTerms(double r, const vector<double>& expiryTimes);
+    GridView PerpetualExponents(double r, double b, const vector<double>& volatilities, const string& optType);
+
+public:
+    GridCache();
+    // Attaches the snapshot at path if there is one
+    explicit GridCache(const string& path);
+
+    bool Attach(const string& path);
+
+    // Laid out as ComputeOptionMatrix returns it: [expiry][strike][volatility]
+    GridView OptionMatrix(double S, double r,
+        const vector<double>& strikes,
+        const vector<double>& volatilities,
+        const vector<double>& expiryTimes,
+        MatrixGreek greek);
+
+    // Laid out as ComputePerpetualMatrix returns it: [strike][volatility]
+    GridView PerpetualMatrix(double S, double r,
+        const vector<double>& strikes,
+        const vector<double>& volatilities,
+        double b,
+        const string& optType);
+
+    // Writes every section used since construction (grids and invariants) to path.
+    // Sections of the attached snapshot that were not used are dropped.
+    bool Save(const string& path) const;
+
+    const GridCacheStats& Stats() const;
+};
+
+#endif // GridSnapshot_HPP
@@ -0,0 +1,248 @@
+
+#include "Instrumentation.hpp"
+#include <cmath>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+    const size_t kKernels = static_cast<size_t>(Kernel::Count);
+
+    // Per-thread counters. Only the owning thread writes them, so increments are a
+    // relaxed load + store; Snapshot() reads them concurrently through the atomics.
+    struct AtomicStats {
+        atomic<uint64_t> calls{ 0 }, batches{ 0 }, batchItems{ 0 };
+        atomic<uint64_t> nanResults{ 0 }, infResults{ 0 }, domainErrors{ 0 };
+        atomic<uint64_t> totalNs{ 0 }, batchNs{ 0 };
+        atomic<uint64_t> latencyNs[kLatencyBuckets] = {};
+        atomic<uint64_t> batchLatencyNs[kLatencyBuckets] = {};
+    };
+
+    inline void Bump(atomic<uint64_t>& c, uint64_t n = 1) {
+        c.store(c.load(memory_order_relaxed) + n, memory_order_relaxed);
+    }
+
+    void Accumulate(KernelStats& out, const AtomicStats& in) {
+        out.calls += in.calls.load(memory_order_relaxed);
+        out.batches += in.batches.load(memory_order_relaxed);
+        out.batchItems += in.batchItems.load(memory_order_relaxed);
+        out.nanResults += in.nanResults.load(memory_order_relaxed);
+        out.infResults += in.infResults.load(memory_order_relaxed);
+        out.domainErrors += in.domainErrors.load(memory_order_relaxed);
+        out.totalNs += in.totalNs.load(memory_order_relaxed);
+        out.batchNs += in.batchNs.load(memory_order_relaxed);
+        for (int i = 0; i < kLatencyBuckets; ++i) {
+            out.latencyNs[i] += in.latencyNs[i].load(memory_order_relaxed);
+            out.batchLatencyNs[i] += in.batchLatencyNs[i].load(memory_order_relaxed);
+        }
+    }
+
+    void Subtract(KernelStats& out, const KernelStats& base) {
+        out.calls -= base.calls;
+        out.batches -= base.batches;
+        out.batchItems -= base.batchItems;
+        out.nanResults -= base.nanResults;
+        out.infResults -= base.infResults;
+        out.domainErrors -= base.domainErrors;
+        out.totalNs -= base.totalNs;
+        out.batchNs -= base.batchNs;
+        for (int i = 0; i < kLatencyBuckets; ++i) {
+            out.latencyNs[i] -= base.latencyNs[i];
+            out.batchLatencyNs[i] -= base.batchLatencyNs[i];
+        }
+    }
+
+    struct ThreadCounters;
+
+    // All live thread blocks plus the totals of threads that have already exited.
+    // The totals only grow; baseline holds them as of the last Reset().
+    struct Registry {
+        mutex lock;
+        vector<ThreadCounters*> live;
+        vector<KernelStats> retired = vector<KernelStats>(kKernels);
+        vector<KernelStats> baseline = vector<KernelStats>(kKernels);
+    };
+
+    Registry& GetRegistry() {
+        static Registry* registry = new Registry();   // never destroyed: threads may exit after main
+        return *registry;
+    }
+
+    struct ThreadCounters {
+        AtomicStats stats[kKernels];
+
+        ThreadCounters() {
+            Registry& reg = GetRegistry();
+            lock_guard<mutex> guard(reg.lock);
+            reg.live.push_back(this);
+        }
+
+        ~ThreadCounters() {
+            Registry& reg = GetRegistry();
+            lock_guard<mutex> guard(reg.lock);
+            for (size_t k = 0; k < kKernels; ++k)
+                Accumulate(reg.retired[k], stats[k]);
+            for (size_t i = 0; i < reg.live.size(); ++i) {
+                if (reg.live[i] == this) {
+                    reg.live[i] = reg.live.back();
+                    reg.live.pop_back();
+                    break;
+                }
+            }
+        }
+    };
+
+    AtomicStats& Local(Kernel k) {
+        thread_local ThreadCounters counters;
+        return counters.stats[static_cast<size_t>(k)];
+    }
+
+    int Bucket(uint64_t ns) {
+        int b = 0;
+        while (ns != 0 && b < kLatencyBuckets - 1) {
+            ns >>= 1;
+            ++b;
+        }
+        return b;
+    }
+
+    // Totals since the start of the process; the caller holds reg.lock
+    vector<KernelStats> Totals(Registry& reg) {
+        vector<KernelStats> totals = reg.retired;
+        for (ThreadCounters* t : reg.live)
+            for (size_t k = 0; k < kKernels; ++k)
+                Accumulate(totals[k], t->stats[k]);
+        return totals;
+    }
+}
+
+namespace Instrumentation {
+
+    atomic<bool> enabled{ false };
+
+    void Enable(bool on) {
+        enabled.store(on, memory_order_relaxed);
+    }
+
+    InstrumentationSnapshot Snapshot() {
+        InstrumentationSnapshot snap;
+        Registry& reg = GetRegistry();
+        lock_guard<mutex> guard(reg.lock);
+
+        snap.kernels = Totals(reg);
+        for (size_t k = 0; k < kKernels; ++k)
+            Subtract(snap.kernels[k], reg.baseline[k]);
+        return snap;
+    }
+
+    void Reset() {
+        Registry& reg = GetRegistry();
+        lock_guard<mutex> guard(reg.lock);
+        reg.baseline = Totals(reg);
+    }
+
+    void RecordCall(Kernel k, uint64_t ns) {
+        AtomicStats& s = Local(k);
+        Bump(s.calls);
+        Bump(s.totalNs, ns);
+        Bump(s.latencyNs[Bucket(ns)]);
+    }
+
+    void RecordBatch(Kernel k, size_t n, uint64_t ns) {
+        AtomicStats& s = Local(k);
+        Bump(s.batches);
+        Bump(s.batchItems, n);
+        Bump(s.batchNs, ns);
+        Bump(s.batchLatencyNs[Bucket(ns)]);
+    }
+
+    void RecordResult(Kernel k, double value) {
+        if (std::isnan(value))
+            Bump(Local(k).nanResults);
+        else if (std::isinf(value))
+            Bump(Local(k).infResults);
+    }
+
+    void RecordDomainError(Kernel k) {
+        Bump(Local(k).domainErrors);
+    }
+}
+
+const char* KernelName(Kernel k) {
+    switch (k) {
+    case Kernel::EuropeanPrice: return "EuropeanPrice";
+    case Kernel::EuropeanDelta: return "EuropeanDelta";
+    case Kernel::EuropeanGamma: return "EuropeanGamma";
+    case Kernel::AmericanPrice: return "AmericanPrice";
+    case Kernel::AmericanDelta: return "AmericanDelta";
+    case Kernel::AmericanGamma: return "AmericanGamma";
+    case Kernel::AmericanGreeks: return "AmericanGreeks";
+    case Kernel::DigitalPrice: return "DigitalPrice";
+    case Kernel::DigitalDelta: return "DigitalDelta";
+    case Kernel::DigitalGamma: return "DigitalGamma";
+    case Kernel::BarrierPrice: return "BarrierPrice";
+    case Kernel::BarrierDelta: return "BarrierDelta";
+    case Kernel::BarrierGamma: return "BarrierGamma";
+    default: return "Unknown";
+    }
+}
+
+string InstrumentationSnapshot::ToText() const {
+    ostringstream out;
+    for (size_t k = 0; k < kernels.size(); ++k) {
+        const KernelStats& s = kernels[k];
+        if (s.calls == 0 && s.batches == 0)
+            continue;
+
+        out << KernelName(static_cast<Kernel>(k))
+            << ": calls=" << s.calls
+            << " batches=" << s.batches
+            << " batchItems=" << s.batchItems
+            << " nan=" << s.nanResults
+            << " inf=" << s.infResults
+            << " domainErrors=" << s.domainErrors
+            << " ns/call=" << (s.calls ? double(s.totalNs) / s.calls : 0.0)
+            << " ns/batchItem=" << (s.batchItems ? double(s.batchNs) / s.batchItems : 0.0) << "\n";
+
+        auto histogram = [&out](const char* label, const uint64_t* buckets) {
+            out << "  " << label << " (ns):";
+            for (int i = 0; i < kLatencyBuckets; ++i)
+                if (buckets[i] != 0)
+                    out << " <" << (uint64_t(1) << i) << ":" << buckets[i];
+            out << "\n";
+        };
+        if (s.calls != 0)
+            histogram("call latency", s.latencyNs);
+        if (s.batches != 0)
+            histogram("batch latency", s.batchLatencyNs);
+    }
+    return out.str();
+}
+
+string InstrumentationSnapshot::ToJson() const {
+    ostringstream out;
+    out << "{\"kernels\":[";
+    for (size_t k = 0; k < kernels.size(); ++k) {
+        const KernelStats& s = kernels[k];
+        if (k != 0)
+            out << ",";
+        out << "{\"name\":\"" << KernelName(static_cast<Kernel>(k)) << "\""
+            << ",\"calls\":" << s.calls
+            << ",\"batches\":" << s.batches
+            << ",\"batchItems\":" << s.batchItems
+            << ",\"nan\":" << s.nanResults
+            << ",\"inf\":" << s.infResults
+            << ",\"domainErrors\":" << s.domainErrors
+            << ",\"totalNs\":" << s.totalNs
+            << ",\"batchNs\":" << s.batchNs
+            << ",\"latencyNs\":[";
+        for (int i = 0; i < kLatencyBuckets; ++i)
+            out << (i ? "," : "") << s.latencyNs[i];
+        out << "],\"batchLatencyNs\":[";
+        for (int i = 0; i < kLatencyBuckets; ++i)
+            out << (i ? "," : "") << s.batchLatencyNs[i];
+        out << "]}";
+    }
+    out << "]}";
+    return out.str();
+}
@@ -0,0 +1,131 @@
+// Instrumentation.hpp
+// Low-overhead counters for the pricing kernels. Every thread records into its
+// own counters; Snapshot() merges them on demand. Recording only happens after
+// Instrumentation::Enable(true), so a compiled-in but idle build pays a single
+// relaxed atomic load per kernel call: INSTRUMENT_DOMAIN and INSTRUMENT_RESULT
+// reuse the flag INSTRUMENT_CALL read. Build with OPTION_INSTRUMENTATION=0 to
+// remove the hooks completely.
+
+#ifndef Instrumentation_HPP
+#define Instrumentation_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#ifndef OPTION_INSTRUMENTATION
+#define OPTION_INSTRUMENTATION 1
+#endif
+
+// The kernels we keep statistics for
+enum class Kernel {
+    EuropeanPrice,
+    EuropeanDelta,
+    EuropeanGamma,
+    AmericanPrice,
+    AmericanDelta,
+    AmericanGamma,
+    AmericanGreeks,
+    DigitalPrice,
+    DigitalDelta,
+    DigitalGamma,
+    BarrierPrice,
+    BarrierDelta,
+    BarrierGamma,
+    Count
+};
+
+const char* KernelName(Kernel k);
+
+// Bucket i of a latency histogram counts calls (or batches) that took [2^(i-1), 2^i) ns
+const int kLatencyBuckets = 32;
+
+struct KernelStats {
+    uint64_t calls = 0;         // single-option evaluations
+    uint64_t batches = 0;       // batch evaluations
+    uint64_t batchItems = 0;    // options priced inside batches
+    uint64_t nanResults = 0;
+    uint64_t infResults = 0;
+    uint64_t domainErrors = 0;  // inputs outside the formula's domain (T <= 0, sigma <= 0, U <= 0)
+    uint64_t totalNs = 0;       // time in single calls
+    uint64_t batchNs = 0;       // time in batches
+    uint64_t latencyNs[kLatencyBuckets] = {};       // per single call
+    uint64_t batchLatencyNs[kLatencyBuckets] = {};  // per whole batch
+};
+
+struct InstrumentationSnapshot {
+    vector<KernelStats> kernels;    // indexed by Kernel
+
+    const KernelStats& operator [] (Kernel k) const { return kernels[static_cast<size_t>(k)]; }
+
+    string ToText() const;
+    string ToJson() const;
+};
+
+namespace Instrumentation {
+
+    extern atomic<bool> enabled;
+
+    inline bool Enabled() { return enabled.load(memory_order_relaxed); }
+    void Enable(bool on);
+
+    // Merges the counters of all threads (live and finished)
+    InstrumentationSnapshot Snapshot();
+    // Later snapshots count from here. The counters themselves are only ever written
+    // by their own thread; Reset records the current totals and Snapshot subtracts them.
+    void Reset();
+
+    void RecordCall(Kernel k, uint64_t ns);
+    void RecordBatch(Kernel k, size_t n, uint64_t ns);
+    void RecordResult(Kernel k, double value);
+    void RecordDomainError(Kernel k);
+
+    inline uint64_t NowNs() {
+        return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Times the enclosing scope as one call (or one batch of n) of a kernel
+    class ScopedTimer {
+    private:
+        Kernel kernel;
+        size_t batch;
+        uint64_t start;
+
+    public:
+        ScopedTimer(Kernel k, size_t n = 0) : kernel(k), batch(n), start(Enabled() ? NowNs() : 0) {}
+        // Whether recording was on when the scope started
+        bool Active() const { return start != 0; }
+        ~ScopedTimer() {
+            if (start == 0)
+                return;
+            uint64_t ns = NowNs() - start;
+            if (batch == 0)
+                RecordCall(kernel, ns);
+            else
+                RecordBatch(kernel, batch, ns);
+        }
+    };
+}
+
+// INSTRUMENT_RESULT and INSTRUMENT_DOMAIN follow an INSTRUMENT_CALL in the same scope
+#if OPTION_INSTRUMENTATION
+#define INSTRUMENT_CALL(k) Instrumentation::ScopedTimer instrumentTimer_((k))
+#define INSTRUMENT_BATCH(k, n) Instrumentation::ScopedTimer instrumentTimer_((k), (n))
+#define INSTRUMENT_RESULT(k, v) \
+    do { if (instrumentTimer_.Active()) Instrumentation::RecordResult((k), (v)); } while (0)
+#define INSTRUMENT_DOMAIN(k, bad) \
+    do { if (instrumentTimer_.Active() && (bad)) Instrumentation::RecordDomainError((k)); } while (0)
+#else
+#define INSTRUMENT_CALL(k) ((void)0)
+#define INSTRUMENT_BATCH(k, n) ((void)0)
+#define INSTRUMENT_RESULT(k, v) ((void)0)
+#define INSTRUMENT_DOMAIN(k, bad) ((void)0)
+#endif
+
+#endif // Instrumentation_HPP
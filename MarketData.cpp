@@ -0,0 +1,204 @@
+// MarketData.cpp
+#include "MarketData.hpp"
+#include "Instrumentation.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+void LatencyHistogram::Add(uint64_t ns)
+{
+    int bucket = 0;
+    while (bucket < kBuckets - 1 && (uint64_t(1) << bucket) <= ns)
+        ++bucket;
+    ++counts[bucket];
+    ++total;
+    maxNs = max(maxNs, ns);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < kBuckets; ++i)
+        counts[i] += other.counts[i];
+    total += other.total;
+    maxNs = max(maxNs, other.maxNs);
+}
+
+uint64_t LatencyHistogram::Quantile(double q) const
+{
+    uint64_t rank = uint64_t(q * double(total));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += counts[i];
+        if (seen >= max<uint64_t>(rank, 1))
+            return min(uint64_t(1) << i, maxNs);
+    }
+    return maxNs;
+}
+
+RepricingEngine::RepricingEngine(size_t underlyings, size_t threads, size_t ringCapacity, bool pinThreads)
+    : underlyingCount(underlyings), threadCount(max<size_t>(threads, 1)), pin(pinThreads),
+    states(underlyings), instrumentsOf(underlyings), running(false)
+{
+    for (size_t u = 0; u < underlyings; ++u)
+        rings.emplace_back(new SpscRing<Tick>(ringCapacity));
+    for (size_t t = 0; t < threadCount; ++t)
+        workers.emplace_back(new Worker());
+    for (size_t u = 0; u < underlyings; ++u)
+        workers[u % threadCount]->underlyings.push_back(u);
+}
+
+RepricingEngine::~RepricingEngine()
+{
+    Stop();
+}
+
+size_t RepricingEngine::Add(size_t underlying, unique_ptr<OptionPrice> instrument)
+{
+    if (underlying >= underlyingCount)
+        throw invalid_argument("RepricingEngine::Add: unknown underlying");
+    instruments.push_back(move(instrument));
+    instrumentsOf[underlying].push_back(instruments.size() - 1);
+    return instruments.size() - 1;
+}
+
+void RepricingEngine::Start()
+{
+    prices.reset(new atomic<double>[instruments.size()]);
+    for (size_t i = 0; i < instruments.size(); ++i)
+        prices[i].store(numeric_limits<double>::quiet_NaN(), memory_order_relaxed);
+
+    running.store(true, memory_order_release);
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t]->th = thread(&RepricingEngine::Run, this, ref(*workers[t]), t);
+}
+
+bool RepricingEngine::Publish(const Tick& tick)
+{
+    if (tick.underlying >= underlyingCount)
+        throw invalid_argument("RepricingEngine::Publish: unknown underlying");
+    return rings[tick.underlying]->TryPush(tick);
+}
+
+void RepricingEngine::Stop()
+{
+    running.store(false, memory_order_release);
+    for (unique_ptr<Worker>& w : workers)
+        if (w->th.joinable())
+            w->th.join();
+}
+
+double RepricingEngine::Price(size_t instrument) const
+{
+    if (!prices || instrument >= instruments.size())
+        return numeric_limits<double>::quiet_NaN();
+    return prices[instrument].load(memory_order_relaxed);
+}
+
+RepricingStats RepricingEngine::Stats() const
+{
+    RepricingStats total;
+    for (const unique_ptr<Worker>& w : workers) {
+        lock_guard<mutex> lock(w->statsMutex);
+        total.ticks += w->stats.ticks;
+        total.conflated += w->stats.conflated;
+        total.repricings += w->stats.repricings;
+        total.instrumentPrices += w->stats.instrumentPrices;
+        total.latency.Merge(w->stats.latency);
+        total.newestLatency.Merge(w->stats.newestLatency);
+    }
+    return total;
+}
+
+void RepricingEngine::Run(Worker& w, size_t cpu)
+{
+#ifdef __linux__
+    if (pin) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(int(cpu % size_t(max(1u, thread::hardware_concurrency()))), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#else
+    (void)cpu;
+#endif
+
+    // Ticks published before Stop() are visible once running reads false, so one
+    // more pass after that drains everything
+    for (;;) {
+        bool live = running.load(memory_order_acquire);
+        bool busy = Drain(w);
+        if (!live && !busy)
+            break;
+        if (!busy)
+            this_thread::yield();
+    }
+}
+
+// Takes the ticks waiting for the worker's underlyings, then reprices each
+// underlying that changed once with its latest spot and vol. At most one ring's
+// capacity is taken per underlying and pass, so a feed that keeps one ring busy
+// cannot hold back the repricing of the others.
+bool RepricingEngine::Drain(Worker& w)
+{
+    bool any = false;
+    uint64_t ticks = 0, conflated = 0;
+    Tick tick;
+    for (size_t u : w.underlyings) {
+        UnderlyingState& st = states[u];
+        SpscRing<Tick>& ring = *rings[u];
+        for (size_t k = 0, limit = ring.Capacity(); k < limit && ring.TryPop(tick); ++k) {
+            ++ticks;
+            if (st.dirty) {
+                ++conflated;
+                st.oldestStampNs = min(st.oldestStampNs, tick.stampNs);
+                st.newestStampNs = max(st.newestStampNs, tick.stampNs);
+            }
+            else {
+                st.oldestStampNs = st.newestStampNs = tick.stampNs;
+            }
+            if (tick.kind == TickKind::Spot) {
+                st.spot = tick.value;
+                st.hasSpot = true;
+            }
+            else {
+                st.vol = tick.value;
+                st.hasVol = true;
+            }
+            st.dirty = true;
+            any = true;
+        }
+    }
+    if (!any)
+        return false;
+
+    lock_guard<mutex> lock(w.statsMutex);
+    w.stats.ticks += ticks;
+    w.stats.conflated += conflated;
+    for (size_t u : w.underlyings) {
+        UnderlyingState& st = states[u];
+        if (!st.dirty)
+            continue;
+        st.dirty = false;
+        if (!st.hasSpot)
+            continue;
+
+        for (size_t i : instrumentsOf[u]) {
+            OptionPrice& option = *instruments[i];
+            option.S = st.spot;
+            if (st.hasVol)
+                option.sigma = st.vol;
+            prices[i].store(option.Price(st.spot), memory_order_relaxed);
+        }
+        ++w.stats.repricings;
+        w.stats.instrumentPrices += instrumentsOf[u].size();
+        uint64_t now = Instrumentation::NowNs();
+        w.stats.latency.Add(now - st.oldestStampNs);
+        w.stats.newestLatency.Add(now - st.newestStampNs);
+    }
+    return true;
+}
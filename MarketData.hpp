@@ -0,0 +1,179 @@
+// MarketData.hpp
+// Live repricing from market data ticks. A feed thread publishes spot and volatility
+// ticks into one single-producer/single-consumer ring per underlying; each repricer
+// thread owns a fixed set of underlyings (underlying % threads), drains their rings,
+// keeps only the latest spot and volatility of every underlying (conflation) and
+// reprices the OptionPrice instruments of each underlying that changed once. The
+// rings are lock-free and their producer and consumer indices sit on separate cache
+// lines; repricers can be pinned to a CPU each (Linux).
+
+#ifndef MarketData_HPP
+#define MarketData_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "OptionPrice.hpp"
+
+using namespace std;
+
+enum class TickKind : uint32_t { Spot, Vol };
+
+struct Tick {
+    uint32_t underlying;
+    TickKind kind;
+    double value;
+    uint64_t stampNs;   // steady clock time the tick was published
+};
+
+const size_t kCacheLine = 64;
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Each side caches the other side's index and only reloads it (one shared cache line
+// transfer) when the ring looks full or empty.
+template <typename T>
+class SpscRing
+{
+private:
+    alignas(kCacheLine) atomic<size_t> head;    // next slot to write (producer)
+    size_t cachedTail;                          // producer's copy of tail
+    alignas(kCacheLine) atomic<size_t> tail;    // next slot to read (consumer)
+    size_t cachedHead;                          // consumer's copy of head
+    alignas(kCacheLine) size_t mask;
+    unique_ptr<T[]> slots;
+
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity)
+        : head(0), cachedTail(0), tail(0), cachedHead(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        mask = size - 1;
+        slots.reset(new T[size]);
+    }
+
+    bool TryPush(const T& value)
+    {
+        size_t h = head.load(memory_order_relaxed);
+        if (h - cachedTail > mask) {
+            cachedTail = tail.load(memory_order_acquire);
+            if (h - cachedTail > mask)
+                return false;
+        }
+        slots[h & mask] = value;
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    size_t Capacity() const
+    {
+        return mask + 1;
+    }
+
+    bool TryPop(T& value)
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t == cachedHead) {
+            cachedHead = head.load(memory_order_acquire);
+            if (t == cachedHead)
+                return false;
+        }
+        value = slots[t & mask];
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+};
+
+// Bucket i counts latencies in [2^(i-1), 2^i) ns, as in Instrumentation.hpp
+struct LatencyHistogram {
+    static const int kBuckets = 40;
+    uint64_t counts[kBuckets] = {};
+    uint64_t total = 0;
+    uint64_t maxNs = 0;
+
+    void Add(uint64_t ns);
+    void Merge(const LatencyHistogram& other);
+    // Upper edge of the bucket holding quantile q (0 < q <= 1)
+    uint64_t Quantile(double q) const;
+};
+
+struct RepricingStats {
+    uint64_t ticks = 0;         // ticks taken from the rings
+    uint64_t conflated = 0;     // ticks folded into the repricing of a later tick
+    uint64_t repricings = 0;    // underlying updates (each reprices all its instruments)
+    uint64_t instrumentPrices = 0;
+    // Tick publication to repriced instruments. A repricing that conflated several
+    // ticks records the oldest one, which waited longest; newestLatency records the
+    // newest one, the age of the state that was priced.
+    LatencyHistogram latency;
+    LatencyHistogram newestLatency;
+};
+
+class RepricingEngine
+{
+private:
+    // Latest conflated market state of one underlying, owned by its repricer (one
+    // cache line each, so repricers do not share lines)
+    struct alignas(kCacheLine) UnderlyingState {
+        double spot = 0.0;
+        double vol = 0.0;
+        bool hasSpot = false;
+        bool hasVol = false;
+        bool dirty = false;
+        uint64_t oldestStampNs = 0;     // of the ticks pending since the last repricing
+        uint64_t newestStampNs = 0;
+    };
+
+    struct alignas(kCacheLine) Worker {
+        thread th;
+        vector<size_t> underlyings;
+        mutex statsMutex;           // taken once per drain pass, and by Stats()
+        RepricingStats stats;
+    };
+
+    size_t underlyingCount;
+    size_t threadCount;
+    bool pin;
+    vector<unique_ptr<SpscRing<Tick>>> rings;           // one per underlying
+    vector<UnderlyingState> states;
+    vector<vector<size_t>> instrumentsOf;               // per underlying
+    vector<unique_ptr<OptionPrice>> instruments;
+    unique_ptr<atomic<double>[]> prices;
+    vector<unique_ptr<Worker>> workers;
+    atomic<bool> running;
+
+    void Run(Worker& w, size_t cpu);
+    bool Drain(Worker& w);
+
+public:
+    RepricingEngine(size_t underlyings, size_t threads, size_t ringCapacity = 1024, bool pinThreads = true);
+    ~RepricingEngine();
+
+    // Instruments are registered before Start(); returns the instrument's index.
+    // Throws invalid_argument for an underlying outside [0, underlyings).
+    size_t Add(size_t underlying, unique_ptr<OptionPrice> instrument);
+
+    void Start();
+    // Only one thread may publish. Returns false if the underlying's ring is full;
+    // throws invalid_argument for an underlying outside [0, underlyings).
+    bool Publish(const Tick& tick);
+    // Waits until every published tick is processed, then joins the repricers
+    void Stop();
+
+    // Latest price of an instrument, NaN until the first spot tick of its underlying
+    // (and before Start() or for an unknown instrument). Instruments keep their own
+    // sigma until a vol tick arrives.
+    double Price(size_t instrument) const;
+
+    // Summed over the repricers. Safe while they run: each one publishes its counters
+    // once per drain pass under its own lock. Complete after Stop().
+    RepricingStats Stats() const;
+};
+
+#endif // MarketData_HPP
@@ -0,0 +1,181 @@
+// MarketReplay.cpp
+// Replays recorded ticks through RepricingEngine and reports the tick-to-price
+// latency histogram. Each tick is published at its recorded offset from the start
+// (divided by --speed; --speed 0 publishes as fast as the rings accept).
+//
+// Usage: option_replay ticks.txt [--threads t] [--instruments n] [--ring capacity]
+//                      [--speed x] [--no-pin]
+//        option_replay --generate ticks.txt [--ticks N] [--underlyings U] [--rate ticks/s]
+//
+// A tick file has one tick per line: "<offset ns> <underlying> <S|V> <value>".
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EuropeanOptionPrice.hpp"
+#include "Instrumentation.hpp"
+#include "MarketData.hpp"
+
+using namespace std;
+
+namespace {
+
+    struct RecordedTick {
+        uint64_t offsetNs;
+        uint32_t underlying;
+        TickKind kind;
+        double value;
+    };
+
+    // Poisson arrivals; spots follow a random walk from 100, one tick in ten is a vol
+    bool Generate(const string& path, size_t ticks, uint32_t underlyings, double rate)
+    {
+        mt19937 gen(11);
+        exponential_distribution<double> gap(rate);
+        normal_distribution<double> move(0.0, 0.0005);
+        uniform_real_distribution<double> u(0.0, 1.0);
+        uniform_int_distribution<uint32_t> pick(0, underlyings - 1);
+
+        vector<double> spots(underlyings, 100.0), vols(underlyings, 0.2);
+        ofstream out(path);
+        double t = 0.0;
+        for (size_t i = 0; i < ticks; ++i) {
+            t += gap(gen);
+            uint32_t k = pick(gen);
+            bool vol = u(gen) < 0.1;
+            if (vol)
+                vols[k] = min(0.6, max(0.05, vols[k] * (1.0 + 20.0 * move(gen))));
+            else
+                spots[k] *= 1.0 + move(gen);
+            out << uint64_t(t * 1e9) << ' ' << k << ' ' << (vol ? 'V' : 'S') << ' '
+                << setprecision(10) << (vol ? vols[k] : spots[k]) << '\n';
+        }
+        return bool(out);
+    }
+
+    bool Load(const string& path, vector<RecordedTick>& ticks, uint32_t& underlyings)
+    {
+        ifstream in(path);
+        if (!in)
+            return false;
+        RecordedTick t;
+        char kind;
+        underlyings = 0;
+        while (in >> t.offsetNs >> t.underlying >> kind >> t.value) {
+            t.kind = kind == 'V' ? TickKind::Vol : TickKind::Spot;
+            ticks.push_back(t);
+            underlyings = max(underlyings, t.underlying + 1);
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    string path, generatePath;
+    size_t threads = 2, instrumentsPer = 64, ring = 1024, ticks = 1000000;
+    uint32_t underlyings = 64;
+    double speed = 1.0, rate = 200000.0;
+    bool pin = true;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto next = [&]() { return (i + 1 < argc) ? string(argv[++i]) : string(); };
+        if (arg == "--threads") threads = stoul(next());
+        else if (arg == "--instruments") instrumentsPer = stoul(next());
+        else if (arg == "--ring") ring = stoul(next());
+        else if (arg == "--speed") speed = stod(next());
+        else if (arg == "--no-pin") pin = false;
+        else if (arg == "--generate") generatePath = next();
+        else if (arg == "--ticks") ticks = stoul(next());
+        else if (arg == "--underlyings") underlyings = uint32_t(stoul(next()));
+        else if (arg == "--rate") rate = stod(next());
+        else if (!arg.empty() && arg[0] != '-' && path.empty()) path = arg;
+        else {
+            cerr << "Usage: option_replay ticks.txt [--threads t] [--instruments n] [--ring capacity]\n"
+                 << "                     [--speed x] [--no-pin]\n"
+                 << "       option_replay --generate ticks.txt [--ticks N] [--underlyings U] [--rate ticks/s]\n";
+            return 1;
+        }
+    }
+
+    if (!generatePath.empty()) {
+        if (!Generate(generatePath, ticks, max(underlyings, 1u), rate)) {
+            cerr << "Cannot write " << generatePath << "\n";
+            return 1;
+        }
+        cout << "Wrote " << ticks << " ticks on " << underlyings << " underlyings to " << generatePath << "\n";
+        return 0;
+    }
+
+    vector<RecordedTick> recorded;
+    if (path.empty() || !Load(path, recorded, underlyings)) {
+        cerr << "Cannot read ticks from '" << path << "'\n";
+        return 1;
+    }
+
+    // Calls and puts on a strike ladder around 100 with expiries up to two years
+    RepricingEngine engine(underlyings, threads, ring, pin);
+    for (uint32_t u = 0; u < underlyings; ++u) {
+        for (size_t i = 0; i < instrumentsPer; ++i) {
+            OptionParams p = { 100.0, 80.0 + 40.0 * double(i % 16) / 15.0, 0.25 * double(1 + i % 8),
+                0.03, 0.2, 0.01, (i % 2) ? "P" : "C" };
+            engine.Add(u, make_unique<EuropeanOptionPrice>(p));
+        }
+    }
+
+    engine.Start();
+    uint64_t start = Instrumentation::NowNs();
+    uint64_t full = 0;
+    for (const RecordedTick& r : recorded) {
+        if (speed > 0.0) {
+            uint64_t due = start + uint64_t(double(r.offsetNs) / speed);
+            while (Instrumentation::NowNs() < due)
+                this_thread::yield();
+        }
+        Tick tick = { r.underlying, r.kind, r.value, Instrumentation::NowNs() };
+        while (!engine.Publish(tick)) {
+            ++full;
+            this_thread::yield();
+        }
+    }
+    double seconds = double(Instrumentation::NowNs() - start) * 1e-9;
+    engine.Stop();
+
+    RepricingStats st = engine.Stats();
+    cout << "ticks " << st.ticks << " in " << fixed << setprecision(3) << seconds << " s ("
+        << setprecision(0) << double(st.ticks) / seconds << " ticks/s), conflated " << st.conflated
+        << ", repricings " << st.repricings << ", instrument prices " << st.instrumentPrices
+        << ", ring full " << full << "\n";
+
+    // The oldest of the ticks conflated into a repricing waited longest; the newest
+    // one is the age of the prices
+    const LatencyHistogram& h = st.latency;
+    const LatencyHistogram& fresh = st.newestLatency;
+    cout << "\ntick-to-price latency (ns)" << setw(12) << "oldest" << setw(12) << "newest" << "\n";
+    for (double q : { 0.5, 0.9, 0.99, 0.999 }) {
+        ostringstream label;
+        label << "  p" << fixed << setprecision(q > 0.99 ? 1 : 0) << q * 100.0 << " <=";
+        cout << left << setw(26) << label.str() << right << setw(12) << h.Quantile(q)
+            << setw(12) << fresh.Quantile(q) << "\n";
+    }
+    cout << left << setw(26) << "  max" << right << setw(12) << h.maxNs << setw(12) << fresh.maxNs << "\n\n";
+
+    cout << setw(14) << "< ns" << setw(12) << "count" << "\n";
+    for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+        if (h.counts[i] == 0)
+            continue;
+        cout << setw(14) << (uint64_t(1) << i) << setw(12) << h.counts[i] << "  "
+            << string(size_t(60.0 * double(h.counts[i]) / double(h.total) + 0.5), '#') << "\n";
+    }
+    return 0;
+}
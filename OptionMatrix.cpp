@@ -1,179 +1,232 @@
 
 #include "OptionMatrix.hpp"
+#include "GridSnapshot.hpp"
+#include "Scheduler.hpp"
+#include <algorithm>
+
+// Grids of at least kParallelCells cells are swept on the shared Scheduler, one
+// (expiry, strike) row of volatilities per item
+namespace {
+    const size_t kParallelCells = 4096;
+}
 
-void PrintOptionMatrix(double S, double r,
+vector<double> ComputeOptionMatrix(double S, double r,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    const vector<double>& expiryTimes)
+    const vector<double>& expiryTimes,
+    MatrixGreek greek)
 {
-    cout << fixed << setprecision(2);
-
-    for (double T : expiryTimes) {
-        cout << "\nExpiry Time: " << T << "\n";
-        cout << setw(10) << "K\\Vol";
-
-        for (double vol : volatilities)
-            cout << setw(10) << vol;
-        cout << endl;
-
-        for (double K : strikes) {
-            cout << setw(10) << K;
-
+    size_t nk = strikes.size(), nv = volatilities.size();
+    vector<double> values(expiryTimes.size() * nk * nv);
+    if (values.empty())
+        return values;
+
+    Scheduler::Shared().ParallelFor(expiryTimes.size() * nk, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            double T = expiryTimes[row / nk];
+            double K = strikes[row % nk];
+            double* out = values.data() + row * nv;
             for (double vol : volatilities) {
                 OptionParams p = { S, K, T, r, vol, r, "C" };
 
                 EuropeanOptionPrice option(p);
 
-                // Now call Price() with the spot price S
-                double price = option.Price(S);  // S as an argument here
-                cout << setw(10) << price;
+                // Now call Price(), Delta() or Gamma() with the spot price S
+                if (greek == MatrixGreek::Price)
+                    *out++ = option.Price(S);
+                else if (greek == MatrixGreek::Delta)
+                    *out++ = option.Delta(S);
+                else
+                    *out++ = option.Gamma(S);
             }
-
-            cout << endl;
         }
-    }
+    }, max<size_t>(1, kParallelCells / nv));
+    return values;
 }
 
-void DeltaMatrix(double S, double r,
+vector<double> ComputePerpetualMatrix(double S, double r,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    const vector<double>& expiryTimes)
+    double b,
+    const string& optType)
 {
-    cout << fixed << setprecision(4);
-
-    for (double T : expiryTimes) {
-        cout << "\nExpiry Time: " << T << "\n";
-        cout << setw(10) << "K\\Vol";
-
-        for (double vol : volatilities)
-            cout << setw(10) << vol;
-        cout << endl;
-
-        for (double K : strikes) {
-            cout << setw(10) << K;
-
+    size_t nv = volatilities.size();
+    vector<double> values(strikes.size() * nv);
+    if (values.empty())
+        return values;
+
+    Scheduler::Shared().ParallelFor(strikes.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            double* out = values.data() + k * nv;
             for (double vol : volatilities) {
-                OptionParams p = { S, K, T, r, vol, r, "C" };
-
-                EuropeanOptionPrice option(p);
-
-                // Now call Price() with the spot price S
-                double price = option.Delta(S);  // Pass S as an argument here
-                cout << setw(10) << price;
+                PerpetualOptionParams op(S, strikes[k], 0.0, vol, r, b, optType);
+                AmericanOptionPrice ao(op);
+                *out++ = ao.Price(S);
             }
-
-            cout << endl;
         }
-    }
+    }, max<size_t>(1, kParallelCells / nv));
+    return values;
 }
 
-void GammaMatrix(double S, double r,
+vector<ReportTable> OptionMatrixTables(const vector<double>& values,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    const vector<double>& expiryTimes)
+    const vector<double>& expiryTimes,
+    MatrixGreek greek,
+    int precision)
 {
-    cout << fixed << setprecision(4);
-
-    for (double T : expiryTimes) {
-        cout << "\nExpiry Time: " << T << "\n";
-        cout << setw(10) << "K\\Vol";
-
-        for (double vol : volatilities)
-            cout << setw(10) << vol;
-        cout << endl;
-
-        for (double K : strikes) {
-            cout << setw(10) << K;
-
-            for (double vol : volatilities) {
-                OptionParams p = { S, K, T, r, vol, r, "C" };
-
-                EuropeanOptionPrice option(p);
-
-                // Now call Price() with the spot price S
-                double price = option.Gamma(S);  // Pass S as an argument here
-                cout << setw(10) << price;
-            }
+    return OptionMatrixTables(values.data(), strikes, volatilities, expiryTimes, greek, precision);
+}
 
-            cout << endl;
-        }
+vector<ReportTable> OptionMatrixTables(const double* values,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const vector<double>& expiryTimes,
+    MatrixGreek greek,
+    int precision)
+{
+    const char* names[] = { "price", "delta", "gamma" };
+    size_t block = strikes.size() * volatilities.size();
+
+    vector<ReportTable> tables;
+    for (size_t i = 0; i < expiryTimes.size(); ++i) {
+        ReportBuffer title(32);
+        title.Append("Expiry Time: ").Fixed(expiryTimes[i], precision);
+
+        ReportTable t;
+        t.title = title.str();
+        t.corner = "K\\Vol";
+        t.rowName = "K";
+        t.columnName = "sigma";
+        t.valueName = names[int(greek)];
+        t.rows = strikes;
+        t.columns = volatilities;
+        t.values = values + i * block;
+        t.precision = precision;
+        tables.push_back(t);
     }
+    return tables;
 }
 
-void PerpetualMatrix(double S, double r,
+ReportTable PerpetualMatrixTable(const vector<double>& values,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    double b) // added as a separate parameter
+    const string& optType,
+    int precision)
 {
-    cout << fixed << setprecision(4);
-
-    cout << "\nPerpetual Call Option Price Matrix:\n";
-    cout << setw(10) << "K\\Vol";
-
-    for (double vol : volatilities)
-        cout << setw(10) << vol;
-    cout << endl;
-
-    for (double K : strikes) {
-        cout << setw(10) << K;
-
-        for (double vol : volatilities) {
-            PerpetualOptionParams p1{ S, K, 0.0, vol, r, b, "C" };
-            PerpetualOptionParams op(p1.S, p1.K, 0.0, p1.sigma, p1.r, p1.b, p1.optType);
-            double tmp = b / (vol * vol);
-            double d = (tmp - 0.5) * (tmp - 0.5);
+    return PerpetualMatrixTable(values.data(), strikes, volatilities, optType, precision);
+}
 
-            double y1 = 0.5 - tmp + sqrt(d + ((2 * r) / (vol * vol)));
+ReportTable PerpetualMatrixTable(const double* values,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const string& optType,
+    int precision)
+{
+    ReportTable t;
+    t.title = (optType == "C") ? "Perpetual Call Option Price Matrix:" : "Perpetual Put Option Price Matrix:";
+    t.corner = "K\\Vol";
+    t.rowName = "K";
+    t.columnName = "sigma";
+    t.valueName = "price";
+    t.rows = strikes;
+    t.columns = volatilities;
+    t.values = values;
+    t.precision = precision;
+    return t;
+}
 
-            double term1 = K / (y1 - 1);
-            double term2 = pow(((y1 - 1) / y1) * (S / K), y1);
-            double beta = term1 * term2;
+// The print functions format the whole grid into one buffer and write it once
+
+namespace {
+
+    void PrintGrid(double S, double r,
+        const vector<double>& strikes,
+        const vector<double>& volatilities,
+        const vector<double>& expiryTimes,
+        MatrixGreek greek,
+        int precision,
+        GridCache* cache)
+    {
+        vector<double> values;
+        const double* grid;
+        if (cache) {
+            grid = cache->OptionMatrix(S, r, strikes, volatilities, expiryTimes, greek).data;
+        }
+        else {
+            values = ComputeOptionMatrix(S, r, strikes, volatilities, expiryTimes, greek);
+            grid = values.data();
+        }
 
-            AmericanOptionPrice ao(op);
+        ReportBuffer out;
+        WriteTables(out, OptionMatrixTables(grid, strikes, volatilities, expiryTimes, greek, precision), ReportFormat::Text);
+        out.Flush(cout);
+    }
 
-            double priceCall = ao.Price(S);
-            cout << setw(10) << priceCall;
+    void PrintPerpetualGrid(double S, double r,
+        const vector<double>& strikes,
+        const vector<double>& volatilities,
+        double b,
+        const string& optType,
+        GridCache* cache)
+    {
+        vector<double> values;
+        const double* grid;
+        if (cache) {
+            grid = cache->PerpetualMatrix(S, r, strikes, volatilities, b, optType).data;
+        }
+        else {
+            values = ComputePerpetualMatrix(S, r, strikes, volatilities, b, optType);
+            grid = values.data();
         }
 
-        cout << endl;
+        ReportBuffer out;
+        WriteTables(out, { PerpetualMatrixTable(grid, strikes, volatilities, optType, 4) }, ReportFormat::Text);
+        out.Flush(cout);
     }
 }
 
-void PerpetualPutMatrix(double S, double r,
+void PrintOptionMatrix(double S, double r,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    double b) // added as a separate parameter
+    const vector<double>& expiryTimes,
+    GridCache* cache)
 {
-    cout << fixed << setprecision(4);
-
-    cout << "\nPerpetual Put Option Price Matrix:\n";
-    cout << setw(10) << "K\\Vol";
-
-    for (double vol : volatilities)
-        cout << setw(10) << vol;
-    cout << endl;
-
-    for (double K : strikes) {
-        cout << setw(10) << K;
-
-        for (double vol : volatilities) {
-            PerpetualOptionParams p1{ S, K, 0.0, vol, r, b, "P" };
-            PerpetualOptionParams op(p1.S, p1.K, 0.0, p1.sigma, p1.r, p1.b, p1.optType);
-            double tmp = b / (vol * vol);
-            double d = (tmp - 0.5) * (tmp - 0.5);
-
-            double y1 = 0.5 - tmp + sqrt(d + ((2 * r) / (vol * vol)));
+    PrintGrid(S, r, strikes, volatilities, expiryTimes, MatrixGreek::Price, 2, cache);
+}
 
-            double term1 = K / (y1 - 1);
-            double term2 = pow(((y1 - 1) / y1) * (S / K), y1);
-            double beta = term1 * term2;
+void DeltaMatrix(double S, double r,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const vector<double>& expiryTimes,
+    GridCache* cache)
+{
+    PrintGrid(S, r, strikes, volatilities, expiryTimes, MatrixGreek::Delta, 4, cache);
+}
 
-            AmericanOptionPrice ao(op);
+void GammaMatrix(double S, double r,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const vector<double>& expiryTimes,
+    GridCache* cache)
+{
+    PrintGrid(S, r, strikes, volatilities, expiryTimes, MatrixGreek::Gamma, 4, cache);
+}
 
-            double pricePut = ao.Price(S);
-            cout << setw(10) << pricePut;
-        }
+void PerpetualMatrix(double S, double r,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    double b, // added as a separate parameter
+    GridCache* cache)
+{
+    PrintPerpetualGrid(S, r, strikes, volatilities, b, "C", cache);
+}
 
-        cout << endl;
-    }
+void PerpetualPutMatrix(double S, double r,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    double b, // added as a separate parameter
+    GridCache* cache)
+{
+    PrintPerpetualGrid(S, r, strikes, volatilities, b, "P", cache);
 }
@@ -6,32 +6,90 @@
 #include <iomanip>
 #include "EuropeanOptionPrice.hpp"
 #include "AmericanOptionPrice.hpp"
+#include "Report.hpp"
 
 using namespace std;
 
+class GridCache;
+
+enum class MatrixGreek { Price, Delta, Gamma };
+
+// European call values at spot S laid out as [expiry][strike][volatility]
+vector<double> ComputeOptionMatrix(double S, double r,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const vector<double>& expiryTimes,
+    MatrixGreek greek);
+
+// Perpetual American prices at spot S laid out as [strike][volatility]
+vector<double> ComputePerpetualMatrix(double S, double r,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    double b,
+    const string& optType);
+
+// One table per expiry (rows = strikes, columns = volatilities) over values laid out
+// as ComputeOptionMatrix returns them. The tables point into values, which must
+// outlive them.
+vector<ReportTable> OptionMatrixTables(const vector<double>& values,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const vector<double>& expiryTimes,
+    MatrixGreek greek,
+    int precision);
+
+// Same over values owned elsewhere, e.g. a GridView of a GridCache
+vector<ReportTable> OptionMatrixTables(const double* values,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const vector<double>& expiryTimes,
+    MatrixGreek greek,
+    int precision);
+
+// Table over the values of ComputePerpetualMatrix (same lifetime rule)
+ReportTable PerpetualMatrixTable(const vector<double>& values,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const string& optType,
+    int precision);
+
+ReportTable PerpetualMatrixTable(const double* values,
+    const vector<double>& strikes,
+    const vector<double>& volatilities,
+    const string& optType,
+    int precision);
+
+// With a GridCache the print functions take their grid from the cache (and its
+// snapshot, see GridSnapshot.hpp) instead of computing it
+
 void PrintOptionMatrix(double S, double r,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    const vector<double>& expiryTimes);
+    const vector<double>& expiryTimes,
+    GridCache* cache = nullptr);
 
 void DeltaMatrix(double S, double r,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    const vector<double>& expiryTimes);
+    const vector<double>& expiryTimes,
+    GridCache* cache = nullptr);
 
 void GammaMatrix(double S, double r,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    const vector<double>& expiryTimes);
+    const vector<double>& expiryTimes,
+    GridCache* cache = nullptr);
 
 void PerpetualMatrix(double S, double r,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    double b);
+    double b,
+    GridCache* cache = nullptr);
 
 void PerpetualPutMatrix(double S, double r,
     const vector<double>& strikes,
     const vector<double>& volatilities,
-    double b);
+    double b,
+    GridCache* cache = nullptr);
 
 #endif // PRINTMATRIX_HPP
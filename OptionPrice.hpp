@@ -2,6 +2,7 @@
 #define OptionPrice_hpp
 
 #include <string>
+#include "Parameters.hpp"
 using namespace std;
 
 class OptionPrice {
@@ -14,6 +15,7 @@ public:
     double sigma;   // Volatility
     double b;       // Cost of carry
     string optType = "C"; // Option type: "C" or "P"
+    CarryModel model = CarryModel::Generic;
 
     OptionPrice() {};
     OptionPrice(const string& optionType) : optType(optionType) {}
@@ -27,6 +29,10 @@ public:
     virtual double Delta(double S) const = 0;
     virtual double Gamma(double S) const = 0;
 
+    // Relative cost of Price, Delta and Gamma at one spot, a European option being 1.
+    // The Scheduler uses it to balance books that mix cheap and expensive contracts.
+    virtual double CostHint() const { return 1.0; }
+
     
 
 
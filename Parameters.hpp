@@ -5,6 +5,16 @@
 #include <string>
 using namespace std;
 
+// Cost-of-carry model. The tag tells the kernels which special case of the
+// generalised Black-Scholes formula applies so they can skip redundant terms.
+enum class CarryModel {
+    Generic,            // any b
+    BlackScholes,       // stock without dividends, b = r
+    Merton,             // stock with continuous dividend yield q, b = r - q
+    Black76,            // options on futures, b = 0
+    GarmanKohlhagen     // FX options with foreign rate rf, b = r - rf
+};
+
 struct OptionParams {
     double S;       // Spot price
     double K;       // Strike price
@@ -13,6 +23,7 @@ struct OptionParams {
     double sigma;   // Volatility
     double b;       // Cost of carry
     string optType = "C"; // Option type: "C" for Call, "P" for Put
+    CarryModel model = CarryModel::Generic;
 
 
 };
@@ -38,6 +49,39 @@ struct PerpetualOptionParams {
 
 
 
+};
+
+enum class DigitalPayoff { CashOrNothing, AssetOrNothing };
+
+struct DigitalOptionParams {
+    double S;       // Spot price
+    double K;       // Strike price
+    double T;       // Time to maturity
+    double r;       // Risk-free interest rate
+    double sigma;   // Volatility
+    double b;       // Cost of carry
+    string optType = "C"; // Option type: "C" for Call, "P" for Put
+    DigitalPayoff payoff = DigitalPayoff::CashOrNothing;
+    double cash = 1.0;    // Amount paid by a cash-or-nothing option
+};
+
+
+
+// Single barrier monitored continuously; "In" options come alive and "Out"
+// options die when the spot touches H
+enum class BarrierType { DownIn, UpIn, DownOut, UpOut };
+
+struct BarrierOptionParams {
+    double S;       // Spot price
+    double K;       // Strike price
+    double T;       // Time to maturity
+    double r;       // Risk-free interest rate
+    double sigma;   // Volatility
+    double b;       // Cost of carry
+    double H;       // Barrier level
+    double rebate = 0.0;  // Cash paid at expiry if an "In" option never knocks in, or at the hit if an "Out" option knocks out
+    string optType = "C"; // Option type: "C" for Call, "P" for Put
+    BarrierType barrier = BarrierType::DownOut;
 };
 
 #endif // OPTIONPARAMS_HPP
@@ -0,0 +1,320 @@
+// Report.cpp
+#include "Report.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <thread>
+
+// Longest fixed representation of a double: 309 integer digits, sign and point
+static const size_t kMaxFixed = 320;
+
+ReportBuffer::ReportBuffer(size_t reserve)
+{
+    buf.reserve(reserve);
+}
+
+// Makes room for n more characters and returns where they go; the caller shrinks
+// the buffer back to what it actually wrote
+char* ReportBuffer::Grow(size_t n)
+{
+    size_t used = buf.size();
+    if (buf.capacity() < used + n)
+        buf.reserve(max(2 * buf.capacity(), used + n));
+    buf.resize(used + n);
+    return &buf[used];
+}
+
+ReportBuffer& ReportBuffer::Append(const char* s)
+{
+    buf.append(s);
+    return *this;
+}
+
+ReportBuffer& ReportBuffer::Append(const string& s)
+{
+    buf.append(s);
+    return *this;
+}
+
+ReportBuffer& ReportBuffer::Append(char c)
+{
+    buf.push_back(c);
+    return *this;
+}
+
+ReportBuffer& ReportBuffer::Pad(const char* s, int width)
+{
+    size_t len = strlen(s);
+    if (width > 0 && len < size_t(width))
+        buf.append(size_t(width) - len, ' ');
+    buf.append(s, len);
+    return *this;
+}
+
+// Writes with to_chars into a stack buffer and appends it right-aligned. Only
+// values that do not fit (huge fixed-point numbers) are written in place.
+template <typename... Args>
+ReportBuffer& ReportBuffer::Format(size_t capacity, int width, Args... args)
+{
+    char tmp[128];
+    to_chars_result res = to_chars(tmp, tmp + sizeof(tmp), args...);
+
+    const char* first = tmp;
+    size_t len = size_t(res.ptr - tmp);
+    size_t start = buf.size();
+    if (res.ec == errc::value_too_large) {
+        char* dst = Grow(capacity);
+        len = size_t(to_chars(dst, dst + capacity, args...).ptr - dst);
+        buf.resize(start + len);
+        first = nullptr;
+    }
+
+    if (width > 0 && len < size_t(width)) {
+        size_t pad = size_t(width) - len;
+        if (first) {
+            buf.append(pad, ' ');
+        }
+        else {
+            buf.insert(start, pad, ' ');
+        }
+    }
+    if (first)
+        buf.append(first, len);
+    return *this;
+}
+
+ReportBuffer& ReportBuffer::Fixed(double v, int precision, int width)
+{
+    return Format(kMaxFixed + size_t(precision), width, v, chars_format::fixed, precision);
+}
+
+ReportBuffer& ReportBuffer::General(double v, int precision, int width)
+{
+    return Format(32 + size_t(precision), width, v, chars_format::general, precision == 0 ? 1 : precision);
+}
+
+ReportBuffer& ReportBuffer::Shortest(double v)
+{
+    return Format(32, 0, v);
+}
+
+ReportBuffer& ReportBuffer::Integer(long long v)
+{
+    return Format(24, 0, v);
+}
+
+ReportBuffer& ReportBuffer::Like(const ostream& out, double v)
+{
+    int precision = int(out.precision());
+    ios_base::fmtflags field = out.flags() & ios_base::floatfield;
+
+    if (field == ios_base::fixed)
+        return Fixed(v, precision);
+    if (field == ios_base::scientific)
+        return Format(32 + size_t(precision), 0, v, chars_format::scientific, precision);
+    return General(v, precision);
+}
+
+ReportBuffer& ReportBuffer::Quoted(const string& s)
+{
+    buf.push_back('"');
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            buf.push_back('\\');
+            buf.push_back(c);
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            const char* hex = "0123456789abcdef";
+            buf.append("\\u00");
+            buf.push_back(hex[(c >> 4) & 0xf]);
+            buf.push_back(hex[c & 0xf]);
+        }
+        else {
+            buf.push_back(c);
+        }
+    }
+    buf.push_back('"');
+    return *this;
+}
+
+const string& ReportBuffer::str() const
+{
+    return buf;
+}
+
+size_t ReportBuffer::size() const
+{
+    return buf.size();
+}
+
+void ReportBuffer::clear()
+{
+    buf.clear();
+}
+
+void ReportBuffer::Flush(ostream& out)
+{
+    out.write(buf.data(), streamsize(buf.size()));
+    out.flush();
+    buf.clear();
+}
+
+bool ReportBuffer::WriteFile(const string& path) const
+{
+    ofstream file(path, ios::binary);
+    file.write(buf.data(), streamsize(buf.size()));
+    return bool(file);
+}
+
+static void WriteText(ReportBuffer& out, const ReportTable& t)
+{
+    out.Append('\n').Append(t.title).Append('\n');
+
+    out.Pad(t.corner.c_str(), t.width);
+    for (double c : t.columns)
+        out.Fixed(c, t.precision, t.width);
+    out.Append('\n');
+
+    const double* v = t.values;
+    for (double r : t.rows) {
+        out.Fixed(r, t.precision, t.width);
+        for (size_t j = 0; j < t.columns.size(); ++j)
+            out.Fixed(*v++, t.precision, t.width);
+        out.Append('\n');
+    }
+}
+
+// CSV fields are quoted only when they need it
+static void CsvField(ReportBuffer& out, const string& s)
+{
+    if (s.find_first_of(",\"\n") == string::npos) {
+        out.Append(s);
+        return;
+    }
+    out.Append('"');
+    for (char c : s) {
+        if (c == '"')
+            out.Append('"');
+        out.Append(c);
+    }
+    out.Append('"');
+}
+
+// The title and the column labels repeat on every line, so they are formatted once
+static void WriteCsv(ReportBuffer& out, const ReportTable& t)
+{
+    ReportBuffer title(64);
+    CsvField(title, t.title);
+    title.Append(',');
+
+    vector<string> columns;
+    for (double c : t.columns) {
+        ReportBuffer label(32);
+        label.Append(',').Shortest(c).Append(',');
+        columns.push_back(label.str());
+    }
+
+    const double* v = t.values;
+    ReportBuffer row(32);
+    for (double r : t.rows) {
+        row.clear();
+        row.Append(title.str()).Shortest(r);
+        for (const string& c : columns)
+            out.Append(row.str()).Append(c).Shortest(*v++).Append('\n');
+    }
+}
+
+static void JsonNumber(ReportBuffer& out, double v)
+{
+    if (std::isfinite(v))
+        out.Shortest(v);
+    else
+        out.Append("null");
+}
+
+static void JsonArray(ReportBuffer& out, const double* v, size_t n)
+{
+    out.Append('[');
+    for (size_t i = 0; i < n; ++i) {
+        if (i)
+            out.Append(',');
+        JsonNumber(out, v[i]);
+    }
+    out.Append(']');
+}
+
+static void WriteJson(ReportBuffer& out, const ReportTable& t)
+{
+    out.Append("{\"title\":").Quoted(t.title);
+    out.Append(",\"row\":").Quoted(t.rowName);
+    out.Append(",\"column\":").Quoted(t.columnName);
+    out.Append(",\"value\":").Quoted(t.valueName);
+    out.Append(",\"rows\":");
+    JsonArray(out, t.rows.data(), t.rows.size());
+    out.Append(",\"columns\":");
+    JsonArray(out, t.columns.data(), t.columns.size());
+    out.Append(",\"values\":[");
+    for (size_t i = 0; i < t.rows.size(); ++i) {
+        if (i)
+            out.Append(',');
+        JsonArray(out, t.values + i * t.columns.size(), t.columns.size());
+    }
+    out.Append("]}");
+}
+
+void WriteTables(ReportBuffer& out, const vector<ReportTable>& tables, ReportFormat format)
+{
+    if (format == ReportFormat::Text) {
+        for (const ReportTable& t : tables)
+            WriteText(out, t);
+    }
+    else if (format == ReportFormat::Csv) {
+        if (tables.empty())
+            return;
+        const ReportTable& first = tables.front();
+        out.Append("table,");
+        CsvField(out, first.rowName);
+        out.Append(',');
+        CsvField(out, first.columnName);
+        out.Append(',');
+        CsvField(out, first.valueName);
+        out.Append('\n');
+        for (const ReportTable& t : tables)
+            WriteCsv(out, t);
+    }
+    else {
+        out.Append("{\"tables\":[");
+        for (size_t i = 0; i < tables.size(); ++i) {
+            out.Append(i ? ",\n" : "\n");
+            WriteJson(out, tables[i]);
+        }
+        out.Append("\n]}\n");
+    }
+}
+
+bool WriteReports(const vector<ReportTable>& tables, const vector<ReportSink>& sinks)
+{
+    vector<ReportBuffer> buffers(sinks.size());
+    vector<char> ok(sinks.size(), 1);
+
+    vector<thread> workers;
+    for (size_t i = 0; i < sinks.size(); ++i) {
+        workers.emplace_back([&, i]() {
+            WriteTables(buffers[i], tables, sinks[i].format);
+            if (sinks[i].path != "-")
+                ok[i] = buffers[i].WriteFile(sinks[i].path);
+        });
+    }
+    for (thread& w : workers)
+        w.join();
+
+    bool all = true;
+    for (size_t i = 0; i < sinks.size(); ++i) {
+        if (sinks[i].path == "-")
+            buffers[i].Flush(cout);
+        all = all && ok[i];
+    }
+    return all;
+}
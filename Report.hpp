@@ -0,0 +1,92 @@
+// Report.hpp
+// Report layer for computed result arrays. Numbers are formatted with std::to_chars
+// into one large buffer that is written out in a single call, instead of going
+// through the iostream formatting (setw, setprecision, endl) cell by cell. The same
+// tables can be written as aligned text, CSV or JSON, and to several sinks in
+// parallel.
+
+#ifndef Report_HPP
+#define Report_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum class ReportFormat { Text, Csv, Json };
+
+// Append-only character buffer. Fixed() matches `cout << fixed << setprecision(p)
+// << setw(w)`, General() matches the default (%g) stream format and Shortest() is
+// the shortest representation that reads back to the same double (CSV and JSON).
+class ReportBuffer
+{
+private:
+    string buf;
+
+    char* Grow(size_t n);
+
+    template <typename... Args>
+    ReportBuffer& Format(size_t capacity, int width, Args... args);
+
+public:
+    explicit ReportBuffer(size_t reserve = 1 << 16);
+
+    ReportBuffer& Append(const char* s);
+    ReportBuffer& Append(const string& s);
+    ReportBuffer& Append(char c);
+
+    // s right-aligned in a field of the given width
+    ReportBuffer& Pad(const char* s, int width);
+
+    ReportBuffer& Fixed(double v, int precision, int width = 0);
+    ReportBuffer& General(double v, int precision = 6, int width = 0);
+    ReportBuffer& Shortest(double v);
+    ReportBuffer& Integer(long long v);
+
+    // Formats v the way the stream would with its current flags and precision
+    ReportBuffer& Like(const ostream& out, double v);
+
+    // JSON string literal with the quotes
+    ReportBuffer& Quoted(const string& s);
+
+    const string& str() const;
+    size_t size() const;
+    void clear();
+
+    // One write of the whole buffer, then the buffer is emptied
+    void Flush(ostream& out);
+    bool WriteFile(const string& path) const;
+};
+
+// Values laid out [row][column] with numeric row and column headers, e.g. one expiry
+// of the option matrix (rows = strikes, columns = volatilities)
+struct ReportTable {
+    string title;           // text line above the table; "table" field in CSV and JSON
+    string corner;          // header of the row label column in text, e.g. "K\\Vol"
+    string rowName;         // CSV/JSON name of the row coordinate, e.g. "K"
+    string columnName;      // CSV/JSON name of the column coordinate, e.g. "sigma"
+    string valueName;       // CSV/JSON name of the values, e.g. "price"
+    vector<double> rows;
+    vector<double> columns;
+    const double* values;   // rows.size() * columns.size(), owned by the caller
+    int precision = 4;      // text only
+    int width = 10;         // text only
+};
+
+// Text: "\n<title>\n", a header line and one line per row, each cell right-aligned in
+// `width` characters. CSV: one "table,row,column,value" line per cell. JSON: an object
+// {"tables": [{"title", "rows", "columns", "values": [[...], ...]}, ...]}.
+void WriteTables(ReportBuffer& out, const vector<ReportTable>& tables, ReportFormat format);
+
+struct ReportSink {
+    string path;            // "-" is standard output
+    ReportFormat format;
+};
+
+// Formats the tables once per sink, each sink on its own thread. The files are
+// written by their thread; standard output is written after the threads join.
+// Returns false if a file could not be written.
+bool WriteReports(const vector<ReportTable>& tables, const vector<ReportSink>& sinks);
+
+#endif // Report_HPP
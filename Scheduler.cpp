@@ -0,0 +1,309 @@
+// Scheduler.cpp
+#include "Scheduler.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include <string>
+
+namespace {
+
+    // Set while the thread runs a task of any scheduler, so nested loops run inline
+    thread_local bool t_inTask = false;
+    // Set by InlineLoops
+    thread_local bool t_inline = false;
+
+    // Marks the thread as running a task for the lifetime of the scope
+    class TaskScope
+    {
+    private:
+        bool saved;
+
+    public:
+        TaskScope() : saved(t_inTask) { t_inTask = true; }
+        ~TaskScope() { t_inTask = saved; }
+    };
+
+    atomic<bool> g_sharedStarted(false);
+
+    // Books below this size are priced in order: balancing them costs more than it saves
+    const size_t kSmallBook = 256;
+
+    size_t ClampThreads(size_t threads)
+    {
+        return min(max<size_t>(threads, 1), Scheduler::kMaxThreads);
+    }
+}
+
+Scheduler::Scheduler(size_t threads)
+    : threadCount(0), body(nullptr), pending(0), steals(0), generation(0), stopping(false)
+{
+    Start(ClampThreads(threads));
+}
+
+Scheduler::~Scheduler()
+{
+    Stop();
+}
+
+Scheduler& Scheduler::Shared()
+{
+    static Scheduler pool([]() {
+        g_sharedStarted.store(true, memory_order_relaxed);
+        const char* env = getenv("OPTION_THREADS");
+        if (env && atoi(env) > 0)
+            return size_t(atoi(env));
+        return size_t(max(1u, thread::hardware_concurrency()));
+    }());
+    return pool;
+}
+
+bool Scheduler::SharedStarted()
+{
+    return g_sharedStarted.load(memory_order_relaxed);
+}
+
+void Scheduler::Start(size_t threads)
+{
+    stopping = false;
+    workers.clear();
+    for (size_t w = 0; w < threads; ++w)
+        workers.emplace_back(new Worker());
+    for (size_t w = 1; w < threads; ++w)
+        workers[w]->th = thread(&Scheduler::Loop, this, w);
+    threadCount.store(threads, memory_order_release);
+}
+
+void Scheduler::Stop()
+{
+    {
+        lock_guard<mutex> lock(wake);
+        stopping = true;
+    }
+    wakeCv.notify_all();
+    for (unique_ptr<Worker>& w : workers)
+        if (w->th.joinable())
+            w->th.join();
+}
+
+void Scheduler::SetThreads(size_t threads)
+{
+    if (t_inTask)
+        throw logic_error("Scheduler::SetThreads: called from inside a task");
+    lock_guard<mutex> lock(submit);
+    threads = ClampThreads(threads);
+    if (threads == workers.size())
+        return;
+    Stop();
+    Start(threads);
+}
+
+size_t Scheduler::Threads() const
+{
+    return threadCount.load(memory_order_acquire);
+}
+
+uint64_t Scheduler::Steals() const
+{
+    return steals.load(memory_order_relaxed);
+}
+
+void Scheduler::Loop(size_t self)
+{
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            unique_lock<mutex> lock(wake);
+            wakeCv.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        RunTasks(self);
+    }
+}
+
+// Own deque from the front, then the other deques from the back, starting after self
+bool Scheduler::Take(size_t self, Task& task)
+{
+    {
+        Worker& w = *workers[self];
+        lock_guard<mutex> lock(w.m);
+        if (!w.tasks.empty()) {
+            task = w.tasks.front();
+            w.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker& victim = *workers[(self + i) % workers.size()];
+        lock_guard<mutex> lock(victim.m);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            steals.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Until every deque is empty; the tasks still running elsewhere finish on their own
+void Scheduler::RunTasks(size_t self)
+{
+    Task task;
+    while (Take(self, task)) {
+        try {
+            TaskScope scope;
+            (*body)(task.begin, task.end);
+        }
+        catch (...) {
+            lock_guard<mutex> lock(errorMutex);
+            if (!error)
+                error = current_exception();
+        }
+
+        if (pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+            { lock_guard<mutex> lock(wake); }
+            doneCv.notify_all();
+        }
+    }
+}
+
+void Scheduler::Run(const vector<size_t>& cuts, const function<void(size_t, size_t)>& range)
+{
+    size_t n = cuts.empty() ? 0 : cuts.back();
+    if (n == 0)
+        return;
+
+    if (t_inTask || t_inline) {
+        range(0, n);
+        return;
+    }
+    // An inline run releases submit first and counts as a task, so its body may
+    // neither deadlock on SetThreads nor start a nested loop on the pool
+    unique_lock<mutex> lock(submit, try_to_lock);
+    if (!lock.owns_lock() || workers.size() == 1 || cuts.size() == 1) {
+        if (lock.owns_lock())
+            lock.unlock();
+        TaskScope scope;
+        range(0, n);
+        return;
+    }
+
+    // Task k goes to worker k % threads, so every deque starts with expensive tasks
+    body = &range;
+    error = nullptr;
+    pending.store(cuts.size(), memory_order_relaxed);
+    size_t begin = 0;
+    for (size_t k = 0; k < cuts.size(); ++k) {
+        Worker& w = *workers[k % workers.size()];
+        lock_guard<mutex> guard(w.m);
+        w.tasks.push_back({ begin, cuts[k] });
+        begin = cuts[k];
+    }
+    {
+        lock_guard<mutex> guard(wake);
+        ++generation;
+    }
+    wakeCv.notify_all();
+
+    RunTasks(0);
+    {
+        unique_lock<mutex> guard(wake);
+        doneCv.wait(guard, [&]() { return pending.load(memory_order_acquire) == 0; });
+    }
+    body = nullptr;
+
+    if (error)
+        rethrow_exception(error);
+}
+
+void Scheduler::ParallelFor(size_t n, const function<void(size_t, size_t)>& body, size_t grain)
+{
+    size_t tasks = min(Threads() * kTasksPerThread, (n + max<size_t>(grain, 1) - 1) / max<size_t>(grain, 1));
+    vector<size_t> cuts;
+    for (size_t k = 1; k <= tasks; ++k)
+        cuts.push_back(n * k / tasks);
+    Run(cuts, body);
+}
+
+void Scheduler::ParallelForEach(const vector<double>& costs, const function<void(size_t)>& body)
+{
+    size_t n = costs.size();
+
+    // Nothing to balance on one thread: skip the sort and the indirect order
+    if (Threads() == 1 || t_inTask || t_inline) {
+        for (size_t i = 0; i < n; ++i)
+            body(i);
+        return;
+    }
+    vector<size_t> order(n);
+    iota(order.begin(), order.end(), size_t(0));
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+    // Tasks of about total / (threads * kTasksPerThread) cost each; an item costlier
+    // than that is a task of its own
+    double total = 0.0;
+    for (double c : costs)
+        total += max(c, 0.0);
+    double target = total / double(Threads() * kTasksPerThread);
+
+    vector<size_t> cuts;
+    double sum = 0.0;
+    for (size_t j = 0; j < n; ++j) {
+        sum += max(costs[order[j]], 0.0);
+        if (sum >= target || j + 1 == n) {
+            cuts.push_back(j + 1);
+            sum = 0.0;
+        }
+    }
+
+    Run(cuts, [&](size_t begin, size_t end) {
+        for (size_t j = begin; j < end; ++j)
+            body(order[j]);
+    });
+}
+
+vector<BookValues> PriceBook(const vector<unique_ptr<OptionPrice>>& book, Scheduler& pool)
+{
+    vector<BookValues> values(book.size());
+    auto price = [&](size_t i) {
+        const OptionPrice& option = *book[i];
+        values[i] = { option.Price(option.S), option.Delta(option.S), option.Gamma(option.S) };
+    };
+
+    if (pool.Threads() == 1 || book.size() < kSmallBook) {
+        for (size_t i = 0; i < book.size(); ++i)
+            price(i);
+        return values;
+    }
+
+    vector<double> costs(book.size());
+    for (size_t i = 0; i < book.size(); ++i)
+        costs[i] = book[i]->CostHint();
+    pool.ParallelForEach(costs, price);
+    return values;
+}
+
+void ParallelRows(size_t rows, const function<void(size_t, size_t)>& body)
+{
+    size_t ranges = (rows + kBatchGrain - 1) / kBatchGrain;
+    if (ranges <= 2 || t_inTask || t_inline) {
+        body(0, rows);
+        return;
+    }
+    Scheduler::Shared().ParallelFor(ranges, [&](size_t begin, size_t end) {
+        body(begin * kBatchGrain, min(rows, end * kBatchGrain));
+    });
+}
+
+InlineLoops::InlineLoops()
+    : saved(t_inline)
+{
+    t_inline = true;
+}
+
+InlineLoops::~InlineLoops()
+{
+    t_inline = saved;
+}
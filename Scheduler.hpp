@@ -0,0 +1,140 @@
+// Scheduler.hpp
+// Work-stealing thread pool shared by the book pricing, the OptionMatrix grid sweeps
+// and the Greeks below. A parallel loop is cut into tasks that are dealt to one
+// deque per worker (the calling thread is worker 0). A worker takes tasks from the
+// front of its own deque; a worker whose deque is empty steals from the back of
+// another one. Loops with per-item costs are ordered by decreasing cost first, so
+// the expensive items start first and sit in the smallest tasks.
+//
+// A parallel loop started from inside a task, or while another thread is using the
+// pool, runs serially on the calling thread, and so does every loop started under an
+// InlineLoops. The workers do not survive fork(), so a forked child must not use a
+// pool its parent started (PriceSharded refuses to fork once Shared has started).
+
+#ifndef Scheduler_HPP
+#define Scheduler_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "OptionPrice.hpp"
+
+using namespace std;
+
+class Scheduler
+{
+private:
+    // Positions [begin, end) in the order of the current loop
+    struct Task {
+        size_t begin;
+        size_t end;
+    };
+
+    struct alignas(64) Worker {
+        mutex m;
+        deque<Task> tasks;
+        thread th;
+    };
+
+    vector<unique_ptr<Worker>> workers;     // workers[0] is the deque of the calling thread
+    atomic<size_t> threadCount;             // workers.size(), readable without submit
+    const function<void(size_t, size_t)>* body;
+    atomic<size_t> pending;                 // tasks of the current loop not finished yet
+    atomic<uint64_t> steals;
+    exception_ptr error;
+    mutex errorMutex;
+
+    mutex submit;                           // one loop at a time
+    mutex wake;
+    condition_variable wakeCv;
+    condition_variable doneCv;
+    uint64_t generation;
+    bool stopping;
+
+    void Start(size_t threads);
+    void Stop();
+    void Loop(size_t self);
+    void RunTasks(size_t self);
+    bool Take(size_t self, Task& task);
+    // Runs tasks [0, n) cut at the given positions; cuts.back() is the loop size
+    void Run(const vector<size_t>& cuts, const function<void(size_t, size_t)>& range);
+
+public:
+    static const size_t kMaxThreads = 256;
+    static const size_t kTasksPerThread = 8;
+
+    // threads is clamped to [1, kMaxThreads]
+    explicit Scheduler(size_t threads);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator = (const Scheduler&) = delete;
+
+    // The pool used by the library: OPTION_THREADS threads if the variable is set,
+    // else one per hardware thread
+    static Scheduler& Shared();
+    // True once Shared has been called in this process
+    static bool SharedStarted();
+
+    // Replaces the workers; waits for a running loop to finish first. Throws
+    // logic_error when called from inside a task, which would wait for itself.
+    void SetThreads(size_t threads);
+    size_t Threads() const;
+
+    // body(begin, end) over [0, n) in ranges of at least grain items. Returns when
+    // every range is done; the first exception thrown by body is rethrown here.
+    void ParallelFor(size_t n, const function<void(size_t, size_t)>& body, size_t grain = 1);
+
+    // body(i) for every i in [0, costs.size()), where costs[i] is the relative cost
+    // of item i (e.g. OptionPrice::CostHint)
+    void ParallelForEach(const vector<double>& costs, const function<void(size_t)>& body);
+
+    // Tasks taken from another worker's deque since construction
+    uint64_t Steals() const;
+};
+
+struct BookValues {
+    double price;
+    double delta;
+    double gamma;
+};
+
+// Price, delta and gamma of every option at its own spot OptionPrice::S, in book
+// order. Mixed books are balanced with the options' cost hints; on a single thread,
+// or for a small book, the options are priced in order without the cost pass.
+vector<BookValues> PriceBook(const vector<unique_ptr<OptionPrice>>& book, Scheduler& pool = Scheduler::Shared());
+
+// Rows per task of the batch kernels (PriceEuropeanBatch, PriceEuropeanTimeRoll, the
+// digital and barrier batches and AmericanOptionPrice::GreeksBatch). A multiple of 64,
+// so two tasks never write the same word of a BatchDomain bitmap.
+const size_t kBatchGrain = 4096;
+
+// body(begin, end) over [0, rows) in ranges of kBatchGrain rows on the shared pool.
+// Batches of up to two ranges, and batches started inside a task, run inline.
+void ParallelRows(size_t rows, const function<void(size_t, size_t)>& body);
+
+// While an InlineLoops lives, every parallel loop its thread starts runs inline and
+// the shared pool is not created (e.g. in a forked worker process)
+class InlineLoops
+{
+private:
+    bool saved;
+
+public:
+    InlineLoops();
+    ~InlineLoops();
+
+    InlineLoops(const InlineLoops&) = delete;
+    InlineLoops& operator = (const InlineLoops&) = delete;
+};
+
+#endif // Scheduler_HPP
@@ -0,0 +1,286 @@
+// ShardedPricing.cpp
+#include "ShardedPricing.hpp"
+#include "CarryModels.hpp"
+#include "Scheduler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+    // Contracts as they are laid out in shared memory (OptionParams holds a string)
+    struct SharedContract {
+        double S;
+        double K;
+        double T;
+        double r;
+        double sigma;
+        double b;
+        int32_t call;
+        int32_t model;
+    };
+
+    // Set by the worker after its results are written
+    struct SharedStatus {
+        atomic<uint32_t> done;
+    };
+
+    // A POSIX shared memory segment, mapped before the workers are forked so they
+    // inherit the mapping. The name is unlinked when the coordinator is done.
+    class SharedSegment
+    {
+    private:
+        string name;
+        void* base;
+        size_t bytes;
+
+    public:
+        explicit SharedSegment(size_t size)
+            : base(MAP_FAILED), bytes(max<size_t>(size, 1))
+        {
+            static atomic<unsigned> counter(0);
+            name = "/optionpricing." + to_string(getpid()) + "." + to_string(counter++);
+
+            int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0)
+                throw runtime_error("PriceSharded: shm_open failed: " + string(strerror(errno)));
+            if (ftruncate(fd, off_t(bytes)) != 0) {
+                close(fd);
+                shm_unlink(name.c_str());
+                throw runtime_error("PriceSharded: ftruncate failed: " + string(strerror(errno)));
+            }
+            base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (base == MAP_FAILED) {
+                shm_unlink(name.c_str());
+                throw runtime_error("PriceSharded: mmap failed: " + string(strerror(errno)));
+            }
+        }
+
+        ~SharedSegment()
+        {
+            munmap(base, bytes);
+            shm_unlink(name.c_str());
+        }
+
+        SharedSegment(const SharedSegment&) = delete;
+        SharedSegment& operator = (const SharedSegment&) = delete;
+
+        void* data() const { return base; }
+    };
+
+    // Book indices sorted by the shard key and cut into contiguous shards of about
+    // the same size; a cut never separates contracts with the same key
+    vector<size_t> Partition(const vector<OptionParams>& book, const ShardOptions& o, vector<ShardStatus>& shards)
+    {
+        // (key, index) pairs sort without touching the book again, and the index
+        // keeps the order of equal keys deterministic
+        size_t n = book.size();
+        vector<pair<double, size_t>> keyed(n);
+        for (size_t i = 0; i < n; ++i)
+            keyed[i] = { o.key == ShardKey::Expiry ? book[i].T : book[i].S, i };
+        sort(keyed.begin(), keyed.end());
+
+        vector<size_t> order(n);
+        for (size_t j = 0; j < n; ++j)
+            order[j] = keyed[j].second;
+
+        size_t count = max<size_t>(o.shards, 1);
+        size_t first = 0;
+        for (size_t s = 0; s < count; ++s) {
+            size_t cut = max(first, (s + 1) * n / count);
+            while (cut > 0 && cut < n && keyed[cut].first == keyed[cut - 1].first)
+                ++cut;
+            ShardStatus st = { first, cut - first, 0, false, { 0.0, 0.0, 0.0, 0.0 } };
+            shards.push_back(st);
+            first = cut;
+        }
+        return order;
+    }
+
+    void RunWorker(const SharedContract* in, ContractGreeks* out, SharedStatus& status,
+        size_t first, size_t count, bool fail, bool hang)
+    {
+        if (fail)
+            _exit(3);
+        while (hang)
+            pause();
+
+        vector<OptionParams> contracts(count);
+        for (size_t i = 0; i < count; ++i) {
+            const SharedContract& c = in[first + i];
+            contracts[i] = { c.S, c.K, c.T, c.r, c.sigma, c.b, c.call ? "C" : "P", CarryModel(c.model) };
+        }
+
+        // Only the forking thread exists here, so the shard is priced on it
+        InlineLoops serial;
+        vector<EuropeanResult> res = PriceEuropeanBatch(contracts);
+        for (size_t i = 0; i < count; ++i) {
+            const OptionParams& p = contracts[i];
+            out[first + i] = { res[i].price, res[i].delta, res[i].gamma, p.S * p.S * p.sigma * p.T * res[i].gamma };
+        }
+
+        status.done.store(1, memory_order_release);
+        _exit(0);
+    }
+
+    void Add(ContractGreeks& total, const ContractGreeks& g)
+    {
+        total.price += g.price;
+        total.delta += g.delta;
+        total.gamma += g.gamma;
+        total.vega += g.vega;
+    }
+}
+
+ShardedResult PriceSharded(const vector<OptionParams>& book, const ShardOptions& options)
+{
+    if (Scheduler::SharedStarted())
+        throw runtime_error("PriceSharded: the shared scheduler has started threads; fork before using it");
+
+    ShardedResult result;
+    result.order = Partition(book, options, result.shards);
+    result.restarts = 0;
+
+    size_t n = book.size();
+    size_t shardCount = result.shards.size();
+
+    SharedSegment input(n * sizeof(SharedContract));
+    SharedSegment output(shardCount * sizeof(SharedStatus) + n * sizeof(ContractGreeks));
+
+    SharedContract* in = static_cast<SharedContract*>(input.data());
+    for (size_t j = 0; j < n; ++j) {
+        const OptionParams& p = book[result.order[j]];
+        in[j] = { p.S, p.K, p.T, p.r, p.sigma, p.b, p.optType == "C", int32_t(p.model) };
+    }
+
+    SharedStatus* status = static_cast<SharedStatus*>(output.data());
+    ContractGreeks* out = reinterpret_cast<ContractGreeks*>(status + shardCount);
+    for (size_t s = 0; s < shardCount; ++s)
+        new (&status[s]) SharedStatus{ { 0 } };
+
+    vector<pid_t> pids(shardCount, -1);
+    vector<chrono::steady_clock::time_point> started(shardCount);
+
+    auto launch = [&](size_t s) {
+        ShardStatus& st = result.shards[s];
+        bool fail = st.attempts == 0 && long(s) == options.failShard;
+        bool hang = st.attempts == 0 && long(s) == options.hangShard;
+        ++st.attempts;
+        status[s].done.store(0, memory_order_relaxed);
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            // Leave no orphans behind: stop and reap every worker already started
+            string reason = strerror(errno);
+            for (pid_t& other : pids) {
+                if (other > 0) {
+                    kill(other, SIGKILL);
+                    waitpid(other, nullptr, 0);
+                    other = -1;
+                }
+            }
+            throw runtime_error("PriceSharded: fork failed: " + reason);
+        }
+        if (pid == 0) {
+            // The child must never return into the coordinator's code
+            try {
+                RunWorker(in, out, status[s], st.first, st.count, fail, hang);
+            }
+            catch (...) {
+            }
+            _exit(4);
+        }
+        pids[s] = pid;
+        started[s] = chrono::steady_clock::now();
+    };
+
+    for (size_t s = 0; s < shardCount; ++s) {
+        if (result.shards[s].count == 0)
+            result.shards[s].complete = true;
+        else
+            launch(s);
+    }
+
+    // Poll the workers; a failed or timed out shard is started again until it runs
+    // out of attempts
+    auto timeout = chrono::duration<double>(options.timeoutSeconds);
+    for (;;) {
+        bool running = false, progress = false;
+        for (size_t s = 0; s < shardCount; ++s) {
+            if (pids[s] < 0)
+                continue;
+
+            int wstatus = 0;
+            bool killed = false;
+            pid_t r = waitpid(pids[s], &wstatus, WNOHANG);
+            if (r == 0 && chrono::steady_clock::now() - started[s] > timeout) {
+                kill(pids[s], SIGKILL);
+                r = waitpid(pids[s], &wstatus, 0);
+                killed = true;
+            }
+            if (r == 0) {
+                running = true;
+                continue;
+            }
+
+            progress = true;
+            pids[s] = -1;
+            bool ok = r > 0 && !killed && WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0
+                && status[s].done.load(memory_order_acquire) == 1;
+
+            if (ok) {
+                result.shards[s].complete = true;
+            }
+            else if (result.shards[s].attempts <= options.maxRestarts) {
+                ++result.restarts;
+                launch(s);
+                running = true;
+            }
+        }
+        if (!running)
+            break;
+        if (!progress)
+            this_thread::sleep_for(chrono::microseconds(200));
+    }
+
+    // Merge in book order
+    const double nan = numeric_limits<double>::quiet_NaN();
+    vector<size_t> shardOf(n);
+    result.contracts.assign(n, { nan, nan, nan, nan });
+    for (size_t s = 0; s < shardCount; ++s) {
+        const ShardStatus& st = result.shards[s];
+        for (size_t j = st.first; j < st.first + st.count; ++j) {
+            shardOf[result.order[j]] = s;
+            if (st.complete)
+                result.contracts[result.order[j]] = out[j];
+        }
+    }
+
+    result.totals = { 0.0, 0.0, 0.0, 0.0 };
+    result.complete = true;
+    for (size_t i = 0; i < n; ++i) {
+        ShardStatus& st = result.shards[shardOf[i]];
+        if (!st.complete)
+            continue;
+        Add(st.totals, result.contracts[i]);
+        Add(result.totals, result.contracts[i]);
+    }
+    for (const ShardStatus& st : result.shards)
+        result.complete = result.complete && st.complete;
+    return result;
+}
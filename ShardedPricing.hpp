@@ -0,0 +1,68 @@
+// ShardedPricing.hpp
+// Prices a book of European contracts across local worker processes. The book is
+// split into shards by underlying (contracts sharing a spot) or by expiry; each
+// shard is priced by a forked worker that reads its contracts from a POSIX shared
+// memory segment and writes price, delta, gamma and vega to a second one. The
+// coordinator restarts shards whose worker crashed, failed or timed out, then
+// merges the results in book order, so the totals do not depend on which worker
+// finished first and match a single-process run bit for bit.
+//
+// Linux only (fork, shm_open, mmap). Call it from a single-threaded process: a
+// forked child only has the calling thread, and the workers price their shards on
+// it. It throws runtime_error if Scheduler::Shared has already been started (any
+// batch of more than two kBatchGrain ranges starts it). If fork fails, the workers
+// already started are killed and reaped before runtime_error is thrown.
+
+#ifndef ShardedPricing_HPP
+#define ShardedPricing_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Parameters.hpp"
+
+using namespace std;
+
+enum class ShardKey { Underlying, Expiry };
+
+struct ShardOptions {
+    size_t shards = 4;
+    ShardKey key = ShardKey::Expiry;
+    int maxRestarts = 2;            // extra attempts per shard
+    double timeoutSeconds = 60.0;   // a worker still running after this is killed
+
+    // Failure injection for testing: the first attempt of this shard exits without
+    // writing its results (failShard) or never finishes (hangShard)
+    long failShard = -1;
+    long hangShard = -1;
+};
+
+struct ContractGreeks {
+    double price;
+    double delta;
+    double gamma;
+    double vega;
+};
+
+struct ShardStatus {
+    size_t first;       // the shard's contracts are order[first, first + count)
+    size_t count;
+    int attempts;
+    bool complete;
+    ContractGreeks totals;
+};
+
+struct ShardedResult {
+    vector<ContractGreeks> contracts;   // book order; NaN for shards that never completed
+    vector<size_t> order;               // book indices grouped by shard
+    vector<ShardStatus> shards;
+    ContractGreeks totals;              // sums over the completed shards, in book order
+    int restarts;
+    bool complete;                      // every shard completed
+};
+
+// Throws runtime_error if the shared scheduler has started, the shared memory
+// segments cannot be created or a worker cannot be started
+ShardedResult PriceSharded(const vector<OptionParams>& book, const ShardOptions& options);
+
+#endif // ShardedPricing_HPP
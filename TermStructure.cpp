@@ -0,0 +1,215 @@
+
+#include "TermStructure.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+TermStructure::TermStructure(double value)
+    : times{ 0.0 }, values{ value }
+{
+    init(Interpolation::Linear);
+}
+
+TermStructure::TermStructure(const vector<double>& pillarTimes, const vector<double>& pillarValues,
+    Interpolation interp)
+    : times(pillarTimes), values(pillarValues)
+{
+    if (times.empty() || times.size() != values.size())
+        throw invalid_argument("TermStructure: need one value per pillar time");
+    if (times[0] < 0.0)
+        throw invalid_argument("TermStructure: pillar times must be non-negative");
+    for (size_t i = 1; i < times.size(); ++i)
+        if (!(times[i] > times[i - 1]))
+            throw invalid_argument("TermStructure: pillar times must be strictly increasing");
+
+    init(interp);
+}
+
+void TermStructure::init(Interpolation interp)
+{
+    size_t n = times.size();
+    moments.assign(n, 0.0);
+
+    // Natural cubic spline: solve the tridiagonal system for the second derivatives
+    // (Thomas algorithm), with M_0 = M_{n-1} = 0
+    if (interp == Interpolation::CubicSpline && n > 2) {
+        vector<double> c(n, 0.0), d(n, 0.0);
+        for (size_t i = 1; i + 1 < n; ++i) {
+            double h0 = times[i] - times[i - 1];
+            double h1 = times[i + 1] - times[i];
+            double rhs = 6.0 * ((values[i + 1] - values[i]) / h1 - (values[i] - values[i - 1]) / h0);
+            double diag = 2.0 * (h0 + h1) - h0 * c[i - 1];
+            c[i] = h1 / diag;
+            d[i] = (rhs - h0 * d[i - 1]) / diag;
+        }
+        for (size_t i = n - 2; i >= 1; --i)
+            moments[i] = d[i] - c[i] * moments[i + 1];
+    }
+
+    // The extrema of a segment are at its pillars or where the derivative, a
+    // quadratic in B = (t - t_i) / h, vanishes
+    minimum = *min_element(values.begin(), values.end());
+    for (size_t i = 0; i + 1 < n; ++i) {
+        double h = times[i + 1] - times[i];
+        double c0 = (values[i + 1] - values[i]) / h - h / 6.0 * (2.0 * moments[i] + moments[i + 1]);
+        double c1 = h * moments[i];
+        double c2 = 0.5 * h * (moments[i + 1] - moments[i]);
+        double roots[2];
+        int count = 0;
+        if (c2 == 0.0) {
+            if (c1 != 0.0)
+                roots[count++] = -c0 / c1;
+        }
+        else {
+            double disc = c1 * c1 - 4.0 * c2 * c0;
+            if (disc >= 0.0) {
+                roots[count++] = (-c1 + sqrt(disc)) / (2.0 * c2);
+                roots[count++] = (-c1 - sqrt(disc)) / (2.0 * c2);
+            }
+        }
+        for (int k = 0; k < count; ++k)
+            if (roots[k] > 0.0 && roots[k] < 1.0)
+                minimum = min(minimum, Value(times[i] + roots[k] * h));
+    }
+
+    cumulative.assign(n, 0.0);
+    cumulative[0] = values[0] * times[0];   // flat before the first pillar
+    for (size_t i = 0; i + 1 < n; ++i)
+        cumulative[i + 1] = cumulative[i] + SegmentIntegral(i, times[i + 1] - times[i]);
+}
+
+double TermStructure::SegmentIntegral(size_t i, double tau) const
+{
+    // With s = tau / h the spline integrates to
+    // h * [ y_i (s - s^2/2) + y_{i+1} s^2/2
+    //       + h^2/6 * ( M_i (-(1-s)^4/4 + (1-s)^2/2 - 1/4) + M_{i+1} (s^4/4 - s^2/2) ) ]
+    double h = times[i + 1] - times[i];
+    double s = tau / h;
+    double u = 1.0 - s;
+
+    double linear = values[i] * (s - 0.5 * s * s) + values[i + 1] * 0.5 * s * s;
+    double curvature = moments[i] * (-0.25 * u * u * u * u + 0.5 * u * u - 0.25)
+        + moments[i + 1] * (0.25 * s * s * s * s - 0.5 * s * s);
+
+    return h * (linear + h * h / 6.0 * curvature);
+}
+
+double TermStructure::IntegralFrom(long i, double T) const
+{
+    if (i < 0)
+        return values[0] * T;
+
+    size_t k = static_cast<size_t>(i);
+    if (k + 1 == times.size())
+        return cumulative[k] + values[k] * (T - times[k]);   // flat after the last pillar
+
+    return cumulative[k] + SegmentIntegral(k, T - times[k]);
+}
+
+double TermStructure::Value(double t) const
+{
+    if (t <= times.front())
+        return values.front();
+    if (t >= times.back())
+        return values.back();
+
+    size_t i = static_cast<size_t>(upper_bound(times.begin(), times.end(), t) - times.begin()) - 1;
+    double h = times[i + 1] - times[i];
+    double B = (t - times[i]) / h;
+    double A = 1.0 - B;
+
+    return A * values[i] + B * values[i + 1]
+        + ((A * A * A - A) * moments[i] + (B * B * B - B) * moments[i + 1]) * h * h / 6.0;
+}
+
+double TermStructure::Minimum() const
+{
+    return minimum;
+}
+
+double TermStructure::Integral(double T) const
+{
+    if (T <= 0.0)
+        return 0.0;
+
+    long i = static_cast<long>(upper_bound(times.begin(), times.end(), T) - times.begin()) - 1;
+    return IntegralFrom(i, T);
+}
+
+double TermStructure::Average(double T) const
+{
+    if (T <= 0.0)
+        return Value(0.0);
+
+    return Integral(T) / T;
+}
+
+vector<double> TermStructure::Integrals(const vector<double>& sortedT) const
+{
+    vector<double> result(sortedT.size());
+    long i = -1;
+    long last = static_cast<long>(times.size()) - 1;
+
+    for (size_t j = 0; j < sortedT.size(); ++j) {
+        double T = sortedT[j];
+        if (T <= 0.0) {
+            result[j] = 0.0;
+            continue;
+        }
+        while (i < last && times[static_cast<size_t>(i + 1)] <= T)
+            ++i;
+        result[j] = IntegralFrom(i, T);
+    }
+    return result;
+}
+
+vector<EuropeanResult> PriceEuropeanBatch(const vector<OptionParams>& contracts,
+    const TermStructure& rate, const TermStructure& carry, const TermStructure& variance)
+{
+    if (variance.Minimum() < 0.0)
+        throw invalid_argument("PriceEuropeanBatch: the variance curve goes negative");
+
+    size_t n = contracts.size();
+
+    // Visit the expiries in ascending order so each curve is walked once
+    vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&contracts](size_t a, size_t b) {
+        return contracts[a].T < contracts[b].T;
+    });
+
+    vector<double> expiries(n);
+    for (size_t j = 0; j < n; ++j)
+        expiries[j] = contracts[order[j]].T;
+
+    vector<double> rT = rate.Integrals(expiries);
+    vector<double> bT = carry.Integrals(expiries);
+    vector<double> vT = variance.Integrals(expiries);
+
+    // Flatten into the sorted book; equal expiries share one set of lookups
+    vector<OptionParams> flat(n);
+    for (size_t j = 0; j < n; ++j) {
+        OptionParams p = contracts[order[j]];
+        double T = p.T;
+        p.model = CarryModel::Generic;
+        if (T > 0.0) {
+            p.r = rT[j] / T;
+            p.b = bT[j] / T;
+            p.sigma = sqrt(vT[j] / T);
+        }
+        else {
+            p.r = rate.Value(0.0);
+            p.b = carry.Value(0.0);
+            p.sigma = sqrt(variance.Value(0.0));
+        }
+        flat[j] = p;
+    }
+
+    vector<EuropeanResult> sorted = PriceEuropeanBatch(flat);
+
+    vector<EuropeanResult> result(n);
+    for (size_t j = 0; j < n; ++j)
+        result[order[j]] = sorted[j];
+    return result;
+}
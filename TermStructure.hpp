@@ -0,0 +1,63 @@
+// TermStructure.hpp
+// Piecewise linear or natural cubic spline curve of an instantaneous quantity
+// (short rate, cost of carry or variance) given at pillar times. The cumulative
+// integral at every pillar is computed once at construction, so the effective
+// r*T, b*T or sigma^2*T of a contract is a binary search plus one segment integral.
+
+#ifndef TermStructure_HPP
+#define TermStructure_HPP
+
+#include <vector>
+#include "Parameters.hpp"
+#include "CarryModels.hpp"
+
+using namespace std;
+
+enum class Interpolation { Linear, CubicSpline };
+
+class TermStructure
+{
+private:
+    vector<double> times;       // pillars t_0 < t_1 < ... < t_{n-1}
+    vector<double> values;      // f(t_i)
+    vector<double> moments;     // f''(t_i) of the natural spline (all zero when linear)
+    vector<double> cumulative;  // F(t_i) = integral of f from 0 to t_i
+    double minimum;             // lowest f(t) over all t, between the pillars too
+
+    void init(Interpolation interp);
+
+    // Integral of f over [t_i, t_i + tau] with 0 <= tau <= t_{i+1} - t_i
+    double SegmentIntegral(size_t i, double tau) const;
+
+    // Integral from 0 to T given the index of the last pillar <= T (-1 when T < t_0)
+    double IntegralFrom(long i, double T) const;
+
+public:
+    // Flat curve
+    explicit TermStructure(double value);
+    // f is flat before the first and after the last pillar
+    TermStructure(const vector<double>& pillarTimes, const vector<double>& pillarValues,
+        Interpolation interp = Interpolation::Linear);
+
+    double Value(double t) const;
+    // A spline can undershoot between the pillars: a steep variance curve goes
+    // negative there even when every pillar value is positive
+    double Minimum() const;
+
+    // Integral of f from 0 to T, O(log n)
+    double Integral(double T) const;
+    // Integral(T) / T: the flat equivalent rate, carry or variance up to T
+    double Average(double T) const;
+
+    // Integral() for ascending expiries in O(n + m) by walking the pillars once
+    vector<double> Integrals(const vector<double>& sortedT) const;
+};
+
+// Prices each contract at its own spot and expiry with the flat-equivalent r, b and
+// sigma implied by the curves; the r, b and sigma fields of the contracts are ignored.
+// Expiries are visited in ascending order so the curve lookups are shared. Throws
+// invalid_argument when the variance curve is negative anywhere.
+vector<EuropeanResult> PriceEuropeanBatch(const vector<OptionParams>& contracts,
+    const TermStructure& rate, const TermStructure& carry, const TermStructure& variance);
+
+#endif // TermStructure_HPP
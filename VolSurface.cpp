@@ -0,0 +1,522 @@
+// VolSurface.cpp
+#include "VolSurface.hpp"
+#include "CarryModels.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+    const double kNaN = numeric_limits<double>::quiet_NaN();
+
+    // Solves A x = y for a small dense system (Gaussian elimination, partial pivoting)
+    bool Solve(vector<double> A, vector<double> y, size_t n, vector<double>& x)
+    {
+        for (size_t c = 0; c < n; ++c) {
+            size_t pivot = c;
+            for (size_t i = c + 1; i < n; ++i)
+                if (fabs(A[i * n + c]) > fabs(A[pivot * n + c]))
+                    pivot = i;
+            if (A[pivot * n + c] == 0.0)
+                return false;
+            if (pivot != c) {
+                for (size_t j = 0; j < n; ++j)
+                    swap(A[c * n + j], A[pivot * n + j]);
+                swap(y[c], y[pivot]);
+            }
+            for (size_t i = c + 1; i < n; ++i) {
+                double f = A[i * n + c] / A[c * n + c];
+                for (size_t j = c; j < n; ++j)
+                    A[i * n + j] -= f * A[c * n + j];
+                y[i] -= f * y[c];
+            }
+        }
+        x.assign(n, 0.0);
+        for (size_t i = n; i-- > 0;) {
+            double s = y[i];
+            for (size_t j = i + 1; j < n; ++j)
+                s -= A[i * n + j] * x[j];
+            x[i] = s / A[i * n + i];
+        }
+        return true;
+    }
+
+    struct LmResult {
+        int iterations;
+        double cost;    // sum of squared residuals
+    };
+
+    // Levenberg-Marquardt with Marquardt's diagonal scaling. eval(x, residuals, jacobian)
+    // fills m residuals and the m x n row-major Jacobian; project(x) moves a trial
+    // point back into the admissible region.
+    template <typename Eval, typename Project>
+    LmResult Minimise(vector<double>& x, size_t m, Eval eval, Project project, int maxIterations, double lambda)
+    {
+        size_t n = x.size();
+        vector<double> res(m), jac(m * n), trialRes(m), trialJac(m * n);
+
+        auto cost = [](const vector<double>& r) {
+            double c = 0.0;
+            for (double v : r)
+                c += v * v;
+            return c;
+        };
+
+        eval(x, res, jac);
+        double current = cost(res);
+
+        LmResult out = { 0, current };
+        vector<double> A(n * n), g(n), step, trial(n);
+        for (int it = 0; it < maxIterations; ++it) {
+            fill(A.begin(), A.end(), 0.0);
+            fill(g.begin(), g.end(), 0.0);
+            for (size_t i = 0; i < m; ++i) {
+                const double* row = &jac[i * n];
+                for (size_t a = 0; a < n; ++a) {
+                    g[a] -= row[a] * res[i];
+                    for (size_t c = 0; c < n; ++c)
+                        A[a * n + c] += row[a] * row[c];
+                }
+            }
+
+            bool accepted = false;
+            double next = current;
+            while (!accepted && lambda < 1e12) {
+                vector<double> D = A;
+                for (size_t a = 0; a < n; ++a)
+                    D[a * n + a] += lambda * (A[a * n + a] + 1e-12);
+                if (!Solve(D, g, n, step))
+                    break;
+
+                // A step below rounding of the parameters means the minimum is reached
+                double size = 0.0, scale = 0.0;
+                for (size_t a = 0; a < n; ++a) {
+                    size = max(size, fabs(step[a]));
+                    scale = max(scale, fabs(x[a]));
+                }
+                if (size <= 1e-12 * scale)
+                    break;
+
+                for (size_t a = 0; a < n; ++a)
+                    trial[a] = x[a] + step[a];
+                project(trial);
+                eval(trial, trialRes, trialJac);
+                next = cost(trialRes);
+
+                if (next < current) {
+                    accepted = true;
+                    lambda = max(lambda / 3.0, 1e-12);
+                }
+                else {
+                    lambda *= 4.0;
+                }
+            }
+            if (!accepted)
+                break;
+
+            x = trial;
+            res.swap(trialRes);
+            jac.swap(trialJac);
+            ++out.iterations;
+
+            bool converged = current - next <= 1e-12 * current + 1e-30;
+            current = next;
+            if (converged)
+                break;
+        }
+        out.cost = current;
+        return out;
+    }
+
+    // Raw SVI parameters are kept with b >= 0, |rho| < 1, sigma > 0, a minimum total
+    // variance >= 0 and Roger Lee's wing bound b (1 + |rho|) <= 4 / T
+    void ProjectSvi(vector<double>& x, double T)
+    {
+        double& a = x[0];
+        double& b = x[1];
+        double& rho = x[2];
+        double& s = x[4];
+
+        rho = min(0.999, max(-0.999, rho));
+        s = max(1e-4, s);
+        b = min(4.0 / (T * (1.0 + fabs(rho))), max(1e-8, b));
+        a = max(-b * s * sqrt(1.0 - rho * rho), a);
+    }
+
+    void ProjectSsvi(vector<double>& x)
+    {
+        double& rho = x[0];
+        double& eta = x[1];
+        double& gamma = x[2];
+
+        rho = min(0.999, max(-0.999, rho));
+        gamma = min(0.5, max(0.01, gamma));
+        eta = min(2.0 / (1.0 + fabs(rho)), max(1e-4, eta));
+    }
+
+    double SsviPhi(double theta, const SsviParams& p)
+    {
+        return p.eta * pow(theta, -p.gamma) * pow(1.0 + theta, p.gamma - 1.0);
+    }
+
+    double SsviVariance(double k, double theta, double phi, double rho)
+    {
+        double u = phi * k + rho;
+        return 0.5 * theta * (1.0 + rho * phi * k + sqrt(u * u + 1.0 - rho * rho));
+    }
+
+    double SsviVariance(double k, double theta, const SsviParams& p)
+    {
+        return SsviVariance(k, theta, SsviPhi(theta, p), p.rho);
+    }
+
+    // Model prices of the book at the given volatilities, with the vega of each quote
+    void PriceWithVega(vector<OptionParams>& book, const vector<double>& sigmas,
+        vector<double>& prices, vector<double>& vegas)
+    {
+        for (size_t i = 0; i < book.size(); ++i)
+            book[i].sigma = sigmas[i];
+
+        vector<EuropeanResult> res = PriceEuropeanBatch(book);
+        for (size_t i = 0; i < book.size(); ++i) {
+            const OptionParams& p = book[i];
+            prices[i] = res[i].price;
+            // Generalized Black-Scholes: vega = S^2 sigma T gamma
+            vegas[i] = p.S * p.S * p.sigma * p.T * res[i].gamma;
+        }
+    }
+}
+
+double SviSlice::TotalVariance(double k) const
+{
+    double dk = k - m;
+    return a + b * (rho * dk + sqrt(dk * dk + sigma * sigma));
+}
+
+vector<double> ImpliedVolatilities(vector<OptionParams> book, const vector<double>& prices)
+{
+    size_t n = book.size();
+    vector<double> lo(n, 1e-4), hi(n, 5.0), sigma(n, 0.3), out(n, kNaN);
+    vector<char> active(n, 1);
+
+    for (size_t i = 0; i < n; ++i) {
+        const OptionParams& p = book[i];
+        double spotCarry = p.S * exp((p.b - p.r) * p.T);
+        double strikeDiscount = p.K * exp(-p.r * p.T);
+        bool call = p.optType == "C";
+        double lower = max(0.0, call ? spotCarry - strikeDiscount : strikeDiscount - spotCarry);
+        double upper = call ? spotCarry : strikeDiscount;
+        if (!(prices[i] > lower && prices[i] < upper))
+            active[i] = 0;
+    }
+
+    vector<double> model(n), vega(n);
+    for (int it = 0; it < 60; ++it) {
+        PriceWithVega(book, sigma, model, vega);
+
+        bool any = false;
+        for (size_t i = 0; i < n; ++i) {
+            if (!active[i])
+                continue;
+            double f = model[i] - prices[i];
+            if (fabs(f) <= 1e-12 * (1.0 + prices[i])) {
+                out[i] = sigma[i];
+                active[i] = 0;
+                continue;
+            }
+            any = true;
+            (f > 0.0 ? hi[i] : lo[i]) = sigma[i];
+
+            // Newton inside the bracket, bisection otherwise
+            double next = sigma[i] - f / vega[i];
+            sigma[i] = (vega[i] > 0.0 && next > lo[i] && next < hi[i]) ? next : 0.5 * (lo[i] + hi[i]);
+        }
+        if (!any)
+            break;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        if (active[i] && hi[i] - lo[i] < 1e-8)
+            out[i] = sigma[i];
+    return out;
+}
+
+VolSurface::VolSurface(double spot, double rate, double carry)
+    : S(spot), r(rate), b(carry), kMin(0.0), kStep(1.0), tMax(0.0), tStep(1.0), nk(0), nt(0)
+{
+}
+
+void VolSurface::SetSpot(double spot)
+{
+    S = spot;
+}
+
+CalibrationReport VolSurface::Calibrate(const vector<OptionQuote>& quotes)
+{
+    return Fit(quotes, false);
+}
+
+CalibrationReport VolSurface::Refit(const vector<OptionQuote>& quotes)
+{
+    return Fit(quotes, !slices.empty());
+}
+
+CalibrationReport VolSurface::Fit(const vector<OptionQuote>& quotes, bool warm)
+{
+    auto start = chrono::steady_clock::now();
+    CalibrationReport report;
+    if (quotes.empty())
+        return report;
+
+    // Quotes by ascending expiry
+    vector<size_t> order(quotes.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) { return quotes[i].T < quotes[j].T; });
+
+    size_t m = quotes.size();
+    vector<OptionParams> book(m);
+    vector<double> target(m), k(m);
+    for (size_t i = 0; i < m; ++i) {
+        const OptionQuote& q = quotes[order[i]];
+        book[i] = { S, q.K, q.T, r, 0.2, b, q.optType };
+        target[i] = q.price;
+        k[i] = log(q.K / S) - b * q.T;  // ln(K / F)
+    }
+
+    // Vega weights turn price residuals into (approximately) volatility residuals;
+    // quotes without an implied volatility get no weight
+    vector<double> iv = ImpliedVolatilities(book, target);
+    vector<double> quoteVol(m), weight(m), model(m), vega(m);
+    for (size_t i = 0; i < m; ++i)
+        quoteVol[i] = std::isnan(iv[i]) ? 0.2 : iv[i];
+    PriceWithVega(book, quoteVol, model, vega);
+    for (size_t i = 0; i < m; ++i)
+        weight[i] = std::isnan(iv[i]) ? 0.0 : 1.0 / max(vega[i], 1e-6 * S * sqrt(book[i].T));
+
+    // Per-expiry SVI
+    vector<SviSlice> fitted;
+    for (size_t first = 0; first < m;) {
+        size_t last = first;
+        while (last < m && book[last].T == book[first].T)
+            ++last;
+        double T = book[first].T;
+        size_t count = last - first;
+
+        vector<OptionParams> slice(book.begin() + first, book.begin() + last);
+        vector<double> sliceSigma(count), slicePrice(count), sliceVega(count);
+
+        auto eval = [&](const vector<double>& x, vector<double>& res, vector<double>& jac) {
+            double a = x[0], bb = x[1], rho = x[2], mm = x[3], s = x[4];
+            for (size_t i = 0; i < count; ++i) {
+                double dk = k[first + i] - mm;
+                double R = sqrt(dk * dk + s * s);
+                double w = max(a + bb * (rho * dk + R), 1e-12);
+                sliceSigma[i] = sqrt(w / T);
+            }
+            PriceWithVega(slice, sliceSigma, slicePrice, sliceVega);
+            for (size_t i = 0; i < count; ++i) {
+                double wt = weight[first + i];
+                double dk = k[first + i] - mm;
+                double R = sqrt(dk * dk + s * s);
+                double dPdw = wt * sliceVega[i] / (2.0 * sliceSigma[i] * T);
+                res[i] = wt * (slicePrice[i] - target[first + i]);
+                double* row = &jac[i * 5];
+                row[0] = dPdw;
+                row[1] = dPdw * (rho * dk + R);
+                row[2] = dPdw * bb * dk;
+                row[3] = -dPdw * bb * (rho + dk / R);
+                row[4] = dPdw * bb * s / R;
+            }
+        };
+
+        vector<double> x;
+        auto previous = find_if(slices.begin(), slices.end(), [T](const SviSlice& s) { return s.T == T; });
+        bool warmSlice = warm && previous != slices.end();
+        if (warmSlice) {
+            x = { previous->a, previous->b, previous->rho, previous->m, previous->sigma };
+        }
+        else {
+            // Cold start from the implied total variances: the wings give b and rho,
+            // the minimum gives m and a
+            size_t lowest = first;
+            for (size_t i = first; i < last; ++i)
+                if (weight[i] > 0.0 && book[i].sigma < book[lowest].sigma)
+                    lowest = i;
+            double wMin = book[lowest].sigma * book[lowest].sigma * T;
+            double wFirst = book[first].sigma * book[first].sigma * T;
+            double wLast = book[last - 1].sigma * book[last - 1].sigma * T;
+            double left = (k[lowest] > k[first]) ? (wFirst - wMin) / (k[lowest] - k[first]) : 0.0;
+            double right = (k[last - 1] > k[lowest]) ? (wLast - wMin) / (k[last - 1] - k[lowest]) : 0.0;
+            double bb = max(0.5 * (left + right), 1e-3);
+            double rho = (left + right > 0.0) ? (right - left) / (right + left) : 0.0;
+            double s = 0.1;
+            x = { wMin - bb * s * sqrt(1.0 - rho * rho), bb, rho, k[lowest], s };
+        }
+        ProjectSvi(x, T);
+
+        LmResult lm = Minimise(x, count, eval, [T](vector<double>& p) { ProjectSvi(p, T); },
+            warmSlice ? 30 : 200, warmSlice ? 1e-4 : 1e-2);
+
+        SviSlice sv = { T, x[0], x[1], x[2], x[3], x[4], sqrt(lm.cost / double(count)), lm.iterations };
+        fitted.push_back(sv);
+        report.sviIterations += lm.iterations;
+        report.sviRmse = max(report.sviRmse, sv.rmse);
+
+        first = last;
+    }
+    slices = fitted;
+
+    // theta(T) from the ATM total variance of the slices, made non-decreasing
+    thetas.clear();
+    for (const SviSlice& sv : slices) {
+        double theta = max(sv.TotalVariance(0.0), 1e-8);
+        if (!thetas.empty())
+            theta = max(theta, thetas.back());
+        thetas.push_back(theta);
+    }
+
+    // SSVI over all quotes with theta fixed per expiry
+    vector<double> quoteTheta(m);
+    for (size_t i = 0, s = 0; i < m; ++i) {
+        while (slices[s].T != book[i].T)
+            ++s;
+        quoteTheta[i] = thetas[s];
+    }
+
+    vector<double> sigmas(m);
+    auto eval = [&](const vector<double>& x, vector<double>& res, vector<double>& jac) {
+        SsviParams p;
+        p.rho = x[0];
+        p.eta = x[1];
+        p.gamma = x[2];
+        for (size_t i = 0; i < m; ++i)
+            sigmas[i] = sqrt(max(SsviVariance(k[i], quoteTheta[i], p), 1e-12) / book[i].T);
+        PriceWithVega(book, sigmas, model, vega);
+        for (size_t i = 0; i < m; ++i) {
+            double theta = quoteTheta[i], kk = k[i];
+            double phi = SsviPhi(theta, p);
+            double u = phi * kk + p.rho;
+            double R = sqrt(u * u + 1.0 - p.rho * p.rho);
+            double dwdphi = 0.5 * theta * (p.rho * kk + u * kk / R);
+            double dPdw = weight[i] * vega[i] / (2.0 * sigmas[i] * book[i].T);
+
+            res[i] = weight[i] * (model[i] - target[i]);
+            double* row = &jac[i * 3];
+            row[0] = dPdw * 0.5 * theta * (phi * kk + phi * kk / R);
+            row[1] = dPdw * dwdphi * phi / p.eta;
+            row[2] = dPdw * dwdphi * phi * log((1.0 + theta) / theta);
+        }
+    };
+
+    vector<double> x;
+    if (warm) {
+        x = { ssvi.rho, ssvi.eta, ssvi.gamma };
+    }
+    else {
+        double rho = 0.0;
+        for (const SviSlice& sv : slices)
+            rho += sv.rho / double(slices.size());
+        x = { rho, 1.0, 0.3 };
+    }
+    ProjectSsvi(x);
+
+    LmResult lm = Minimise(x, m, eval, ProjectSsvi, warm ? 30 : 200, warm ? 1e-4 : 1e-2);
+    ssvi.rho = x[0];
+    ssvi.eta = x[1];
+    ssvi.gamma = x[2];
+    report.ssviIterations = lm.iterations;
+    report.ssviRmse = sqrt(lm.cost / double(max<size_t>(m, 1)));
+
+    // The lookup grid covers the quoted log-moneyness range with half its width on
+    // each side, and expiries up to 1.5 times the last one
+    double kLo = *min_element(k.begin(), k.end());
+    double kHi = *max_element(k.begin(), k.end());
+    double span = max(kHi - kLo, 0.1);
+    BuildGrid(kLo - 0.5 * span, kHi + 0.5 * span);
+
+    report.calibrated = true;
+    report.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+void VolSurface::BuildGrid(double kLo, double kHi)
+{
+    nk = 257;
+    nt = 129;
+    kMin = kLo;
+    kStep = (kHi - kLo) / double(nk - 1);
+    tMax = 1.5 * slices.back().T;
+    tStep = tMax / double(nt - 1);
+
+    grid.assign(nk * nt, 0.0);
+    for (size_t j = 1; j < nt; ++j) {
+        double theta = Theta(double(j) * tStep);
+        double phi = SsviPhi(theta, ssvi);
+        for (size_t i = 0; i < nk; ++i)
+            grid[j * nk + i] = SsviVariance(kMin + double(i) * kStep, theta, phi, ssvi.rho);
+    }
+}
+
+// Linear between the calibrated expiries; constant ATM volatility outside them
+double VolSurface::Theta(double T) const
+{
+    if (slices.empty())
+        return kNaN;
+    if (T <= slices.front().T)
+        return thetas.front() * T / slices.front().T;
+    if (T >= slices.back().T)
+        return thetas.back() * T / slices.back().T;
+
+    size_t j = size_t(upper_bound(slices.begin(), slices.end(), T,
+        [](double t, const SviSlice& s) { return t < s.T; }) - slices.begin());
+    double t0 = slices[j - 1].T, t1 = slices[j].T;
+    return thetas[j - 1] + (thetas[j] - thetas[j - 1]) * (T - t0) / (t1 - t0);
+}
+
+double VolSurface::TotalVariance(double k, double T) const
+{
+    return SsviVariance(k, Theta(T), ssvi);
+}
+
+double VolSurface::SigmaExact(double K, double T) const
+{
+    double k = log(K / S) - b * T;
+    return sqrt(TotalVariance(k, T) / T);
+}
+
+double VolSurface::Sigma(double K, double T) const
+{
+    double k = log(K / S) - b * T;
+    double x = (k - kMin) / kStep;
+    double y = T / tStep;
+    // Below the first grid expiry w(k, T) is far from linear in T; the formula is used there
+    if (grid.empty() || !(y >= 1.0) || !(x >= 0.0) || x > double(nk - 1) || y > double(nt - 1))
+        return SigmaExact(K, T);
+
+    size_t i = min(size_t(x), nk - 2);
+    size_t j = min(size_t(y), nt - 2);
+    double fx = x - double(i), fy = y - double(j);
+
+    const double* row0 = &grid[j * nk + i];
+    const double* row1 = row0 + nk;
+    double w = (1.0 - fy) * ((1.0 - fx) * row0[0] + fx * row0[1]) + fy * ((1.0 - fx) * row1[0] + fx * row1[1]);
+    return sqrt(w / T);
+}
+
+void VolSurface::Apply(vector<OptionParams>& book) const
+{
+    for (OptionParams& p : book)
+        p.sigma = SigmaExact(p.K, p.T);
+}
+
+const vector<SviSlice>& VolSurface::Slices() const
+{
+    return slices;
+}
+
+const SsviParams& VolSurface::Ssvi() const
+{
+    return ssvi;
+}
@@ -0,0 +1,115 @@
+// VolSurface.hpp
+// Implied volatility surface calibrated to option quotes. Each expiry is fitted
+// with raw SVI, then one SSVI surface (Gatheral-Jacquier, power-law phi) is fitted
+// across expiries with the ATM total variances of the slices as theta(T). The SSVI
+// parameters are kept inside the no-arbitrage region: theta is non-decreasing in T
+// (no calendar arbitrage) and eta (1 + |rho|) <= 2 with 0 < gamma <= 1/2 (no
+// butterfly arbitrage).
+//
+// Both fits are Levenberg-Marquardt on vega-weighted price residuals. The model
+// prices come from PriceEuropeanBatch and the Jacobian from the analytic vega
+// (S^2 sigma T gamma of the batch results) times dsigma/dparameter. Refit() starts
+// from the previous parameters, so an intraday refit takes a few iterations.
+//
+// Sigma(K, T) reads a precomputed total variance grid (uniform in log-moneyness and
+// T, bilinear), so a lookup is O(1) whatever the number of expiries. The grid is an
+// approximation: on the test surface of option_bench it is within 3e-4 vol of
+// SigmaExact inside the quoted strikes and expiries, about 1e-3 outside them and up
+// to 5e-3 in the far wings of expiries shorter than the first quote. Off the grid and
+// below its first expiry step Sigma returns SigmaExact.
+
+#ifndef VolSurface_HPP
+#define VolSurface_HPP
+
+#include <string>
+#include <vector>
+#include "Parameters.hpp"
+
+using namespace std;
+
+struct OptionQuote {
+    double K;
+    double T;
+    double price;
+    string optType = "C";
+};
+
+// Raw SVI slice: w(k) = a + b (rho (k - m) + sqrt((k - m)^2 + sigma^2)), k = ln(K / F)
+struct SviSlice {
+    double T;
+    double a;
+    double b;
+    double rho;
+    double m;
+    double sigma;
+    double rmse;        // root mean square vega-weighted residual (about the vol error)
+    int iterations;
+
+    double TotalVariance(double k) const;
+};
+
+struct SsviParams {
+    double rho = -0.3;
+    double eta = 1.0;
+    double gamma = 0.3;
+};
+
+struct CalibrationReport {
+    bool calibrated = false;    // false when there was nothing to fit (no quotes)
+    int sviIterations = 0;      // summed over the expiries
+    int ssviIterations = 0;
+    double sviRmse = 0.0;       // worst slice
+    double ssviRmse = 0.0;
+    double milliseconds = 0.0;
+};
+
+class VolSurface
+{
+private:
+    double S;
+    double r;
+    double b;
+
+    vector<SviSlice> slices;    // ascending T
+    vector<double> thetas;      // ATM total variance per slice, non-decreasing
+    SsviParams ssvi;
+
+    // Total variance grid for Sigma()
+    double kMin, kStep;
+    double tMax, tStep;
+    size_t nk, nt;
+    vector<double> grid;        // [t][k]
+
+    CalibrationReport Fit(const vector<OptionQuote>& quotes, bool warm);
+    void BuildGrid(double kLo, double kHi);
+
+public:
+    VolSurface(double spot, double rate, double carry);
+
+    // Fits from scratch. Without quotes the surface is left as it was and the report
+    // says calibrated = false.
+    CalibrationReport Calibrate(const vector<OptionQuote>& quotes);
+    // Fits starting from the current parameters (expiries not seen before start cold)
+    CalibrationReport Refit(const vector<OptionQuote>& quotes);
+
+    // The quotes of a refit are quoted against this spot
+    void SetSpot(double spot);
+
+    double Theta(double T) const;                       // ATM total variance at T
+    double TotalVariance(double k, double T) const;     // SSVI w(k, theta(T))
+    double SigmaExact(double K, double T) const;        // from the SSVI formula
+    double Sigma(double K, double T) const;             // from the grid, O(1), see above
+
+    // Sets p.sigma of each contract from the SSVI formula (SigmaExact)
+    void Apply(vector<OptionParams>& book) const;
+
+    const vector<SviSlice>& Slices() const;
+    const SsviParams& Ssvi() const;
+};
+
+// Implied volatilities of the quotes priced as book (sigma ignored), by safeguarded
+// Newton steps on the whole book through PriceEuropeanBatch; NaN when the price is
+// outside the no-arbitrage bounds
+vector<double> ImpliedVolatilities(vector<OptionParams> book, const vector<double>& prices);
+
+#endif // VolSurface_HPP
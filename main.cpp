@@ -7,13 +7,27 @@
 #include "CheckParity.hpp"
 #include "Greeks.hpp"
 #include "AmericanOptionPrice.hpp"
+#include "Instrumentation.hpp"
+#include "CarryModels.hpp"
+#include "GridSnapshot.hpp"
 #include <vector>
+#include <cstdlib>
 #include <memory>
 
 using namespace std;
 
 int main() {
 
+    // Kernel statistics are collected only when OPTION_STATS is set in the environment
+    bool collectStats = getenv("OPTION_STATS") != nullptr;
+    Instrumentation::Enable(collectStats);
+
+    // The grids are read from (and saved back to) a snapshot file when OPTION_GRID_SNAPSHOT names one
+    const char* snapshotPath = getenv("OPTION_GRID_SNAPSHOT");
+    unique_ptr<GridCache> grids;
+    if (snapshotPath)
+        grids = make_unique<GridCache>(snapshotPath);
+
     // This part creates a vector called batch, where each element is an OptionParams struct with six values
     vector<OptionParams> batch = {
         {102, 122, 1.65, 0.045, 0.43, 0.0},
@@ -66,7 +80,7 @@ int main() {
     double r = 0.05, S = 100.0;
 
     //option Matrix of spot prices
-    PrintOptionMatrix(S, r, strikes, volatilities, expiryTimes);
+    PrintOptionMatrix(S, r, strikes, volatilities, expiryTimes, grids.get());
 
     // Greeks
     OptionParams dp = { 102, 122, 1.65 , 0.045 , 0.43, 0 };
@@ -94,11 +108,11 @@ int main() {
 
     // Matrix with deltas for different strikes and volatilities
     cout << "\n\nDelta matrix" << endl;
-    DeltaMatrix(S, r, strikes, volatilities, expiryTimes);
+    DeltaMatrix(S, r, strikes, volatilities, expiryTimes, grids.get());
     
     // Matrix with gammas for different strikes and volatilities
     cout << "\n\nGamma matrix" << endl;
-    GammaMatrix(S, r, strikes, volatilities, expiryTimes);
+    GammaMatrix(S, r, strikes, volatilities, expiryTimes, grids.get());
 
     // American perpetual options 
     // American perpetual option parameters (T = 0)
@@ -133,11 +147,27 @@ int main() {
         cout << "S: " << S << " | Call: " << c << " | Put: " << put << endl;
     }
 
+    // Closed-form perpetual call sensitivities over the same mesh, computed in one batch
+    cout << "\nPerpetual American call sensitivities:" << endl;
+    vector<double> perpetualStrikes(S_mesh.size(), 100.0);
+    vector<PerpetualGreeks> perpetualGreeks = AmericanOptionPrice::GreeksBatch(S_mesh, perpetualStrikes, 0.1, 0.1, 0.02, "C");
+    for (size_t i = 0; i < S_mesh.size(); ++i) {
+        const PerpetualGreeks& g = perpetualGreeks[i];
+        cout << "S: " << S_mesh[i] << " | Call: " << g.price << " | Delta: " << g.delta
+            << " | Gamma: " << g.gamma << " | Vega: " << g.vega << " | Rho: " << g.rho << endl;
+    }
+
     // We print perpetual call prices as a function of K and sigma
-    PerpetualMatrix(110, 0.1, strikes, volatilities, 0.02);
+    PerpetualMatrix(110, 0.1, strikes, volatilities, 0.02, grids.get());
 
     // We print perpetual put prices as a function of K and sigma
-    PerpetualPutMatrix(110, 0.1, strikes, volatilities, 0.02);
+    PerpetualPutMatrix(110, 0.1, strikes, volatilities, 0.02, grids.get());
+
+    if (grids && !grids->Save(snapshotPath))
+        cerr << "Cannot write the grid snapshot " << snapshotPath << "\n";
+
+    if (collectStats)
+        cout << "\nKernel statistics:\n" << Instrumentation::Snapshot().ToText();
 
     return 0;
 }